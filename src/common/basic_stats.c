@@ -5,10 +5,8 @@
 #include <stdlib.h>
 
 /* PSP Common headers */
-#include "../common/output.h"
-
-/* PSP Slave headers */
 #include "basic_stats.h"
+#include "output.h"
 
 /* basic statistics management functions */
 void reset_basic_stats(struct basic_stats *st_ptr)
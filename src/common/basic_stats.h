@@ -1,5 +1,5 @@
-#ifndef PSPS_BASIC_STATS_H
-#define PSPS_BASIC_STATS_H
+#ifndef PSP_COMMON_BASIC_STATS_H
+#define PSP_COMMON_BASIC_STATS_H
 
 /* basic statistics data structure */
 struct basic_stats
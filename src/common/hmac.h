@@ -2,10 +2,19 @@
 #define PSP_COMMON_HMAC_H
 
 /* C standard library headers */
+#include <stddef.h>
 #include <stdint.h>
 
+/* HMAC keyed context structure */
+struct hmac_context
+{
+  uint32_t inner[8];
+  uint32_t outer[8];
+};
+
 /* HMAC management functions */
-void generate_hmac(size_t, uint8_t *, const uint8_t *, const uint8_t *);
-int verify_hmac(size_t, const uint8_t *, const uint8_t *, const uint8_t *);
+void init_hmac_context(struct hmac_context *, const uint8_t *);
+void generate_hmac(size_t, uint8_t *, const uint8_t *, const struct hmac_context *);
+int verify_hmac(size_t, const uint8_t *, const uint8_t *, const struct hmac_context *);
 
 #endif /* PSP_COMMON_HMAC_H */
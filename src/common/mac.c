@@ -0,0 +1,287 @@
+/* C standard library headers */
+#include <stdlib.h>
+#include <string.h>
+
+/* PSP Common headers */
+#include "mac.h"
+
+/* rotation macros */
+#define ROTL64(x,b) (((x) << (b)) | ((x) >> (64 - (b))))
+#define ROTR32(x,b) (((x) >> (b)) | ((x) << (32 - (b))))
+
+/* SipHash round macro */
+#define SIPROUND do{							\
+    v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32);	\
+    v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2;				\
+    v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0;				\
+    v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32);	\
+  }while(0)
+
+/* BLAKE2s mixing macro */
+#define BLAKE2S_G(a,b,c,d,x,y) do{					\
+    v[a] = v[a] + v[b] + (x); v[d] = ROTR32(v[d] ^ v[a], 16);		\
+    v[c] = v[c] + v[d]; v[b] = ROTR32(v[b] ^ v[c], 12);			\
+    v[a] = v[a] + v[b] + (y); v[d] = ROTR32(v[d] ^ v[a], 8);		\
+    v[c] = v[c] + v[d]; v[b] = ROTR32(v[b] ^ v[c], 7);			\
+  }while(0)
+
+/* MAC algorithms table */
+struct mac_alg_desc
+{
+  const char *name;
+  size_t min_tag_len;
+  size_t max_tag_len;
+  size_t default_tag_len;
+};
+
+static const struct mac_alg_desc mac_algs[] = {
+  {"hmac-sha256", 4, 32, 32},
+  {"siphash", 4, 8, 8},
+  {"blake2s", 4, 32, 16}
+};
+
+/* BLAKE2s constants */
+static const uint32_t blake2s_iv[8] = {
+  0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+  0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+static const uint8_t blake2s_sigma[10][16] = {
+  { 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+  {14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3},
+  {11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4},
+  { 7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8},
+  { 9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13},
+  { 2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9},
+  {12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11},
+  {13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10},
+  { 6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5},
+  {10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0}
+};
+
+/* functions forward declarations */
+static int is_legacy_mac(const struct mac_context *);
+static uint8_t mac_id(const struct mac_context *);
+static void compute_tag(const struct mac_context *, const uint8_t *, size_t, uint8_t *);
+static uint64_t siphash24(const uint64_t *, const uint8_t *, size_t);
+static void blake2s_compress(uint32_t *, const uint8_t *, uint32_t, int);
+static uint32_t load32_le(const uint8_t *);
+static uint64_t load64_le(const uint8_t *);
+
+/* packet MAC management functions */
+void init_mac_spec(struct mac_spec *spec_ptr)
+{
+  spec_ptr->alg = mac_hmac_sha256;
+  spec_ptr->tag_len = 32;
+}
+
+int parse_mac_spec(const char *spec, struct mac_spec *spec_ptr)
+{
+  /* the specification is <algorithm>[:<tag length in bytes>] */
+  const char *sep = strchr(spec, ':');
+  size_t name_len = sep ? (size_t) (sep - spec) : strlen(spec);
+  char *end_ptr;
+  long tag_len;
+
+  for(int i = 0; i < (int) (sizeof(mac_algs) / sizeof(mac_algs[0])); i++){
+    if((strlen(mac_algs[i].name) != name_len) || strncmp(mac_algs[i].name, spec, name_len)){
+      continue;
+    }
+    spec_ptr->alg = i;
+    if(!sep){
+      spec_ptr->tag_len = mac_algs[i].default_tag_len;
+      return 1;
+    }
+    tag_len = strtol(sep + 1, &end_ptr, 10);
+    if((end_ptr == sep + 1) || (*end_ptr != '\0') ||
+       (tag_len < (long) mac_algs[i].min_tag_len) || (tag_len > (long) mac_algs[i].max_tag_len)){
+      return 0;
+    }
+    spec_ptr->tag_len = (size_t) tag_len;
+    return 1;
+  }
+  return 0;
+}
+
+const char *mac_alg_name(int alg)
+{
+  return mac_algs[alg].name;
+}
+
+void init_mac_context(struct mac_context *mac_ptr, const struct mac_spec *spec_ptr,
+		      const uint8_t *key_ptr)
+{
+  uint8_t block[64];
+
+  memset(mac_ptr, 0, sizeof(*mac_ptr));
+  mac_ptr->alg = spec_ptr->alg;
+  mac_ptr->tag_len = spec_ptr->tag_len;
+  switch(mac_ptr->alg){
+  case mac_hmac_sha256:
+    init_hmac_context(&mac_ptr->hmac_ctx, key_ptr);
+    break;
+  case mac_siphash:
+    /* SipHash uses the first 16 bytes of the key */
+    mac_ptr->sip_key[0] = load64_le(key_ptr);
+    mac_ptr->sip_key[1] = load64_le(key_ptr + 8);
+    break;
+  case mac_blake2s:
+    /* the key block is always followed by data, so it is compressed once here */
+    memcpy(mac_ptr->blake2s_h, blake2s_iv, sizeof(blake2s_iv));
+    mac_ptr->blake2s_h[0] ^= 0x01010000 ^ (32 << 8) ^ (uint32_t) mac_ptr->tag_len;
+    memset(block, 0, sizeof(block));
+    memcpy(block, key_ptr, 32);
+    blake2s_compress(mac_ptr->blake2s_h, block, 64, 0);
+    memset(block, 0, sizeof(block));
+    break;
+  }
+}
+
+size_t mac_trailer_size(const struct mac_context *mac_ptr)
+{
+  return (is_legacy_mac(mac_ptr) ? 0 : 1) + mac_ptr->tag_len;
+}
+
+void write_mac(const struct mac_context *mac_ptr, uint8_t *pkt_ptr, size_t length)
+{
+  /* the algorithm identifier follows the payload and is authenticated with it */
+  if(!is_legacy_mac(mac_ptr)){
+    pkt_ptr[length++] = mac_id(mac_ptr);
+  }
+  compute_tag(mac_ptr, pkt_ptr, length, pkt_ptr + length);
+}
+
+int check_mac(const struct mac_context *mac_ptr, const uint8_t *pkt_ptr, size_t length)
+{
+  uint8_t tag[32];
+  uint8_t diff = 0;
+
+  if(!is_legacy_mac(mac_ptr) && (pkt_ptr[length++] != mac_id(mac_ptr))){
+    return 0;
+  }
+  compute_tag(mac_ptr, pkt_ptr, length, tag);
+  for(size_t i = 0; i < mac_ptr->tag_len; i++){
+    diff |= tag[i] ^ pkt_ptr[length + i];
+  }
+  return diff == 0;
+}
+
+/* helper functions */
+static int is_legacy_mac(const struct mac_context *mac_ptr)
+{
+  /* full length HMAC-SHA256 keeps the original packet format */
+  return (mac_ptr->alg == mac_hmac_sha256) && (mac_ptr->tag_len == 32);
+}
+
+static uint8_t mac_id(const struct mac_context *mac_ptr)
+{
+  return (uint8_t) ((mac_ptr->alg << 6) | (int) (mac_ptr->tag_len - 1));
+}
+
+static void compute_tag(const struct mac_context *mac_ptr, const uint8_t *data_ptr,
+			size_t length, uint8_t *tag_ptr)
+{
+  uint8_t digest[32];
+  uint8_t block[64];
+  uint32_t h[8];
+  uint64_t sip;
+
+  switch(mac_ptr->alg){
+  case mac_hmac_sha256:
+    generate_hmac(length, digest, data_ptr, &mac_ptr->hmac_ctx);
+    memcpy(tag_ptr, digest, mac_ptr->tag_len);
+    break;
+  case mac_siphash:
+    sip = siphash24(mac_ptr->sip_key, data_ptr, length);
+    for(size_t i = 0; i < mac_ptr->tag_len; i++){
+      tag_ptr[i] = (uint8_t) (sip >> (8 * i));
+    }
+    break;
+  case mac_blake2s:
+    /* timestamp packets fit in the single final block */
+    memcpy(h, mac_ptr->blake2s_h, sizeof(h));
+    memset(block, 0, sizeof(block));
+    memcpy(block, data_ptr, length);
+    blake2s_compress(h, block, 64 + (uint32_t) length, 1);
+    for(size_t i = 0; i < mac_ptr->tag_len; i++){
+      tag_ptr[i] = (uint8_t) (h[i >> 2] >> (8 * (i & 3)));
+    }
+    break;
+  }
+}
+
+static uint64_t siphash24(const uint64_t *key, const uint8_t *data_ptr, size_t length)
+{
+  uint64_t v0 = key[0] ^ 0x736f6d6570736575ULL;
+  uint64_t v1 = key[1] ^ 0x646f72616e646f6dULL;
+  uint64_t v2 = key[0] ^ 0x6c7967656e657261ULL;
+  uint64_t v3 = key[1] ^ 0x7465646279746573ULL;
+  uint64_t b = ((uint64_t) length) << 56;
+  uint64_t m;
+  size_t left = length & 7;
+  const uint8_t *end_ptr = data_ptr + length - left;
+
+  for(; data_ptr != end_ptr; data_ptr += 8){
+    m = load64_le(data_ptr);
+    v3 ^= m;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= m;
+  }
+  for(size_t i = 0; i < left; i++){
+    b |= ((uint64_t) data_ptr[i]) << (8 * i);
+  }
+  v3 ^= b;
+  SIPROUND;
+  SIPROUND;
+  v0 ^= b;
+  v2 ^= 0xff;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static void blake2s_compress(uint32_t *h, const uint8_t *block, uint32_t count, int last)
+{
+  uint32_t m[16];
+  uint32_t v[16];
+
+  for(int i = 0; i < 16; i++){
+    m[i] = load32_le(block + 4 * i);
+  }
+  for(int i = 0; i < 8; i++){
+    v[i] = h[i];
+    v[i + 8] = blake2s_iv[i];
+  }
+  v[12] ^= count;
+  if(last){
+    v[14] = ~v[14];
+  }
+  for(int r = 0; r < 10; r++){
+    const uint8_t *s = blake2s_sigma[r];
+    BLAKE2S_G(0, 4,  8, 12, m[s[ 0]], m[s[ 1]]);
+    BLAKE2S_G(1, 5,  9, 13, m[s[ 2]], m[s[ 3]]);
+    BLAKE2S_G(2, 6, 10, 14, m[s[ 4]], m[s[ 5]]);
+    BLAKE2S_G(3, 7, 11, 15, m[s[ 6]], m[s[ 7]]);
+    BLAKE2S_G(0, 5, 10, 15, m[s[ 8]], m[s[ 9]]);
+    BLAKE2S_G(1, 6, 11, 12, m[s[10]], m[s[11]]);
+    BLAKE2S_G(2, 7,  8, 13, m[s[12]], m[s[13]]);
+    BLAKE2S_G(3, 4,  9, 14, m[s[14]], m[s[15]]);
+  }
+  for(int i = 0; i < 8; i++){
+    h[i] ^= v[i] ^ v[i + 8];
+  }
+}
+
+static uint32_t load32_le(const uint8_t *ptr)
+{
+  return ((uint32_t) ptr[0]) | ((uint32_t) ptr[1] << 8) |
+    ((uint32_t) ptr[2] << 16) | ((uint32_t) ptr[3] << 24);
+}
+
+static uint64_t load64_le(const uint8_t *ptr)
+{
+  return ((uint64_t) load32_le(ptr)) | ((uint64_t) load32_le(ptr + 4) << 32);
+}
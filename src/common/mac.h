@@ -0,0 +1,45 @@
+#ifndef PSP_COMMON_MAC_H
+#define PSP_COMMON_MAC_H
+
+/* C standard library headers */
+#include <stddef.h>
+#include <stdint.h>
+
+/* PSP Common headers */
+#include "hmac.h"
+
+/* packet MAC algorithms enumeration */
+enum mac_alg
+{
+  mac_hmac_sha256 = 0,
+  mac_siphash = 1,
+  mac_blake2s = 2
+};
+
+/* packet MAC specification structure */
+struct mac_spec
+{
+  int alg;
+  size_t tag_len;
+};
+
+/* packet MAC context structure */
+struct mac_context
+{
+  int alg;
+  size_t tag_len;
+  struct hmac_context hmac_ctx;
+  uint64_t sip_key[2];
+  uint32_t blake2s_h[8];
+};
+
+/* packet MAC management functions */
+void init_mac_spec(struct mac_spec *);
+int parse_mac_spec(const char *, struct mac_spec *);
+const char *mac_alg_name(int);
+void init_mac_context(struct mac_context *, const struct mac_spec *, const uint8_t *);
+size_t mac_trailer_size(const struct mac_context *);
+void write_mac(const struct mac_context *, uint8_t *, size_t);
+int check_mac(const struct mac_context *, const uint8_t *, size_t);
+
+#endif /* PSP_COMMON_MAC_H */
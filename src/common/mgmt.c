@@ -20,7 +20,7 @@ void install_signal_handler(void);
 void signal_handler(int);
 
 /* globals */
-jmp_buf buf;
+__thread jmp_buf buf;
 
 /* state management functions */
 int run_managed(managed_main_t main_func, main_finalizer_t fini_func, void *data_ptr)
@@ -39,6 +39,17 @@ int run_managed(managed_main_t main_func, main_finalizer_t fini_func, void *data
   return res == clean_exit_code ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
+int run_managed_thread(managed_main_t main_func, void *data_ptr)
+{
+  int res;
+
+  if((res = setjmp(buf)) == no_exit_yet){
+    (*main_func)(data_ptr);
+    res = clean_exit_code;
+  }
+  return res == clean_exit_code;
+}
+
 void clean_exit()
 {
   longjmp(buf, clean_exit_code);
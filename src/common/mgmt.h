@@ -7,6 +7,7 @@ typedef void (*main_finalizer_t)(void *);
 
 /* state management functions */
 int run_managed(managed_main_t, main_finalizer_t, void *);
+int run_managed_thread(managed_main_t, void *);
 void clean_exit(void);
 void fatal_exit(void);
 
@@ -0,0 +1,74 @@
+/* Configuration header */
+#include "../config.h"
+
+/* C standard library headers */
+#include <stdio.h>
+#include <string.h>
+
+/* POSIX library headers */
+#include <arpa/inet.h>
+#include <netdb.h>
+
+/* PSP Common headers */
+#include "net.h"
+
+/* socket address management functions */
+int parse_sockaddr(const char *str, struct sockaddr_storage *addr_ptr)
+{
+  struct addrinfo hints;
+  struct addrinfo *res;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_flags = AI_NUMERICHOST;
+  if(getaddrinfo(str, NULL, &hints, &res) != 0){
+    return 0;
+  }
+  memset(addr_ptr, 0, sizeof(*addr_ptr));
+  memcpy(addr_ptr, res->ai_addr, res->ai_addrlen);
+  freeaddrinfo(res);
+  return 1;
+}
+
+socklen_t sockaddr_len(const struct sockaddr_storage *addr_ptr)
+{
+  return addr_ptr->ss_family == AF_INET6 ?
+    sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+}
+
+void set_sockaddr_port(struct sockaddr_storage *addr_ptr, in_port_t port)
+{
+  if(addr_ptr->ss_family == AF_INET6){
+    ((struct sockaddr_in6 *) addr_ptr)->sin6_port = port;
+  }else{
+    ((struct sockaddr_in *) addr_ptr)->sin_port = port;
+  }
+}
+
+int is_multicast_sockaddr(const struct sockaddr_storage *addr_ptr)
+{
+  if(addr_ptr->ss_family == AF_INET6){
+    return IN6_IS_ADDR_MULTICAST(&((const struct sockaddr_in6 *) addr_ptr)->sin6_addr);
+  }else{
+    return IN_MULTICAST(ntohl(((const struct sockaddr_in *) addr_ptr)->sin_addr.s_addr));
+  }
+}
+
+const char *sockaddr_to_str(const struct sockaddr_storage *addr_ptr, char *buff, size_t size)
+{
+  char host[INET6_ADDRSTRLEN + IF_NAMESIZE + 1];
+  char serv[8];
+  if(getnameinfo((const struct sockaddr *) addr_ptr, sockaddr_len(addr_ptr),
+		 host, sizeof(host), serv, sizeof(serv),
+		 NI_NUMERICHOST | NI_NUMERICSERV) != 0){
+    snprintf(buff, size, "<unknown>");
+  }else if(!strcmp(serv, "0")){
+    snprintf(buff, size, "%s", host);
+  }else if(addr_ptr->ss_family == AF_INET6){
+    snprintf(buff, size, "[%s]:%s", host, serv);
+  }else{
+    snprintf(buff, size, "%s:%s", host, serv);
+  }
+  return buff;
+}
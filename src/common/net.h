@@ -0,0 +1,22 @@
+#ifndef PSP_COMMON_NET_H
+#define PSP_COMMON_NET_H
+
+/* C standard library headers */
+#include <stddef.h>
+
+/* POSIX library headers */
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/* socket address string buffer size */
+#define SOCKADDR_STR_LEN (INET6_ADDRSTRLEN + IF_NAMESIZE + 10)
+
+/* socket address management functions */
+int parse_sockaddr(const char *, struct sockaddr_storage *);
+socklen_t sockaddr_len(const struct sockaddr_storage *);
+void set_sockaddr_port(struct sockaddr_storage *, in_port_t);
+int is_multicast_sockaddr(const struct sockaddr_storage *);
+const char *sockaddr_to_str(const struct sockaddr_storage *, char *, size_t);
+
+#endif /* PSP_COMMON_NET_H */
@@ -12,11 +12,15 @@
 #include <unistd.h>
 
 /* PSP Common headers */
+#include "mac.h"
+#include "net.h"
 #include "options.h"
 #include "output.h"
+#include "rt.h"
 
 /* globals */
 const struct num_ubounds verb_bounds = {erro_lvl, debg_lvl};
+const struct num_bounds rt_prio_bounds = {1, 99};
 
 /* functions prototypes */
 char *gen_opt_string(struct option_descriptor *);
@@ -31,6 +35,7 @@ int parse_opts(struct option_descriptor* ods_ptr, int argc, char **argv)
     return 0;
   
   int res = 1;
+  optind = 1;
   while((c = getopt(argc, argv, optstring)) != -1){
     if((c == ':') || (c == '?')){
       printf("invalid options\n");
@@ -154,6 +159,9 @@ void init_general_options(struct general_options *gen_opts_ptr)
 {
   gen_opts_ptr->verb_lvl = info_lvl;
   gen_opts_ptr->log_fname = NULL;
+  gen_opts_ptr->rt_prio = 0;
+  gen_opts_ptr->cpu_list = NULL;
+  gen_opts_ptr->lock_mem = 0;
 }
 
 void apply_general_options(const struct general_options *gen_opts_ptr)
@@ -162,6 +170,7 @@ void apply_general_options(const struct general_options *gen_opts_ptr)
   if(gen_opts_ptr->log_fname){
     set_logfile(gen_opts_ptr->log_fname);
   }
+  apply_rt_options(gen_opts_ptr);
 }
 
 /* helper functions */
@@ -375,6 +384,28 @@ int opt_in_port_apply(struct option_descriptor *opt_desc_ptr, const char *arg, c
   return 1;
 }
 
+int opt_sockaddr_apply(struct option_descriptor *opt_desc_ptr, const char *arg, const void *data_ptr)
+{
+  struct sockaddr_storage *trgt_addr = (struct sockaddr_storage *) opt_desc_ptr->trgt;
+  (void) data_ptr;
+  if(!parse_sockaddr(arg, trgt_addr)){
+    printf("option '-%c': invalid IP address \"%s\"\n", opt_desc_ptr->letter, arg);
+    return 0;
+  }
+  return 1;
+}
+
+int opt_mac_apply(struct option_descriptor *opt_desc_ptr, const char *arg, const void *data_ptr)
+{
+  struct mac_spec *trgt_spec = (struct mac_spec *) opt_desc_ptr->trgt;
+  (void) data_ptr;
+  if(!parse_mac_spec(arg, trgt_spec)){
+    printf("option '-%c': invalid MAC specification \"%s\"\n", opt_desc_ptr->letter, arg);
+    return 0;
+  }
+  return 1;
+}
+
 int opt_str_apply(struct option_descriptor *opt_desc_ptr, const char *arg, const void *data_ptr)
 {
   const char **trgt_str = (const char **) opt_desc_ptr->trgt;
@@ -23,6 +23,9 @@ struct general_options
 {
   int verb_lvl;
   char *log_fname;
+  int rt_prio;
+  char *cpu_list;
+  int lock_mem;
 };
 
 struct num_bounds
@@ -51,6 +54,7 @@ struct opt_group
 
 /* globals declarations */
 extern const struct num_ubounds verb_bounds;
+extern const struct num_bounds rt_prio_bounds;
 
 /* option register management */
 int parse_opts(struct option_descriptor *, int, char **);
@@ -75,6 +79,8 @@ int opt_double_apply(struct option_descriptor *, const char *, const void *);
 int opt_str_apply(struct option_descriptor *, const char *, const void *);
 int opt_in_addr_apply(struct option_descriptor *, const char *, const void *);
 int opt_in_port_apply(struct option_descriptor *, const char *, const void *);
+int opt_sockaddr_apply(struct option_descriptor *, const char *, const void *);
+int opt_mac_apply(struct option_descriptor *, const char *, const void *);
 
 /* option groups definition macros */
 #define END_OPTS_GROUP {NULL, NULL}
@@ -98,13 +104,19 @@ int opt_in_port_apply(struct option_descriptor *, const char *, const void *);
 #define STR_OPT(L, D, T, R, F) {L, 1, D, 0, T, &opt_str_apply, NULL, R, F}
 #define IN_ADDR_OPT(L, D, T, R, F) {L, 1, D, 0, T, &opt_in_addr_apply, NULL, R, F}
 #define IN_PORT_OPT(L, D, T, R, F) {L, 1, D, 0, T, &opt_in_port_apply, NULL, R, F}
+#define SOCKADDR_OPT(L, D, T, R, F) {L, 1, D, 0, T, &opt_sockaddr_apply, NULL, R, F}
+#define MAC_OPT(L, D, T, R, F) {L, 1, D, 0, T, &opt_mac_apply, NULL, R, F}
 
 /* general options macros */
 #define GEN_OPTS(DATA) SIMPLE_OPT('h', "displays this help message", "", ""), \
     STR_OPT('l', "<filename>, specifies the log file", &DATA.log_fname, "", "h"),\
     BND_INT_OPT('v', "<integer>, set verbosity level (0=ERRO, 1=WARN, 2=INFO, 3=DEBG)",\
-		&DATA.verb_lvl, &verb_bounds, "", "h")
+		&DATA.verb_lvl, &verb_bounds, "", "h"),\
+    BND_INT_OPT('P', "<integer>, runs with the specified SCHED_FIFO real-time priority",\
+		&DATA.rt_prio, &rt_prio_bounds, "", "h"),\
+    STR_OPT('A', "<cpu list>, pins the process to the listed CPUs (e.g. 0,2-3)", &DATA.cpu_list, "", "h"),\
+    FLAG_OPT('L', "locks memory and pre-faults buffers after initialization", &DATA.lock_mem, "", "h")
 
-#define GEN_OPTS_GROUP OPTS_GROUP("general options", "hlv")
+#define GEN_OPTS_GROUP OPTS_GROUP("general options", "hlvPAL")
 
 #endif /* PSP_COMMON_OPTIONS_H */
@@ -14,6 +14,7 @@ static const char *tags[5] = {"ERRO", "WARN", "INFO", "DEBG"};
 /* globals */
 enum output_lvl verb_lvl;
 FILE *log_file;
+const char *out_tag;
 
 /* function prototypes */
 const char *verbosity_to_str(enum output_lvl);
@@ -43,11 +44,18 @@ void set_logfile(const char *filename)
   }
 }
 
+/* output tag management functions */
+void set_output_tag(const char *tag)
+{
+  out_tag = tag;
+}
+
 /* output management functions */
 void init_output()
 {
   verb_lvl = erro_lvl;
   log_file = NULL;
+  out_tag = NULL;
 }
 
 void fini_output(void)
@@ -62,19 +70,25 @@ void output(enum output_lvl lvl, const char *fmt, ...)
   va_list ap, ap2;
   FILE * file_ptr;
   size_t fmt_len;
+  size_t tag_len;
   char *fmt_ext;
 
   if((lvl <= verb_lvl) || log_file){
     fmt_len = strlen(fmt);
-    fmt_ext = malloc(fmt_len + 10);
+    tag_len = out_tag ? strlen(out_tag) + 1 : 0;
+    fmt_ext = malloc(fmt_len + tag_len + 10);
     if(fmt_ext){
       va_start(ap, fmt);
       fmt_ext[0] = '[';
       memcpy(fmt_ext + 1, verbosity_to_str(lvl), 4);
       fmt_ext[5] = ']';
       fmt_ext[6] = ' ';
-      memcpy(fmt_ext + 7, fmt, fmt_len);
-      strcpy(fmt_ext + fmt_len + 7, "\n");
+      if(out_tag){
+	memcpy(fmt_ext + 7, out_tag, tag_len - 1);
+	fmt_ext[tag_len + 6] = ' ';
+      }
+      memcpy(fmt_ext + tag_len + 7, fmt, fmt_len);
+      strcpy(fmt_ext + tag_len + fmt_len + 7, "\n");
       if(log_file){
 	va_copy(ap2, ap);
       	vfprintf(log_file, fmt_ext, ap2);
@@ -14,6 +14,9 @@ enum output_lvl verbosity(void);
 /* log management functions */
 void set_logfile(const char *);
 
+/* output tag management functions */
+void set_output_tag(const char *);
+
 /* output management functions */
 void init_output(void);
 void fini_output(void);
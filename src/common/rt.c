@@ -0,0 +1,121 @@
+/* Configuration header */
+#include "../config.h"
+
+/* C standard library headers */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* POSIX library headers */
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+/* PSP Common headers */
+#include "output.h"
+#include "rt.h"
+
+/* constants */
+#define PREFAULT_STACK_SIZE (256 * 1024)
+
+/* functions forward declarations */
+static int parse_cpu_list(const char *, cpu_set_t *);
+static void prefault_stack(void);
+
+/* real-time profile management functions */
+void apply_rt_options(const struct general_options *gen_opts_ptr)
+{
+  cpu_set_t cpus;
+  struct sched_param param;
+
+  if(gen_opts_ptr->cpu_list){
+    if(!parse_cpu_list(gen_opts_ptr->cpu_list, &cpus)){
+      output(erro_lvl, "invalid CPU list '%s'", gen_opts_ptr->cpu_list);
+    }else if(sched_setaffinity(0, sizeof(cpus), &cpus) == -1){
+      output(erro_lvl, "failure setting CPU affinity: %s", strerror(errno));
+    }
+    output(info_lvl, "pinned to CPUs %s", gen_opts_ptr->cpu_list);
+  }
+  if(gen_opts_ptr->rt_prio > 0){
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = gen_opts_ptr->rt_prio;
+    if(sched_setscheduler(0, SCHED_FIFO, &param) == -1){
+      output(erro_lvl, "failure setting SCHED_FIFO priority %d: %s",
+	     gen_opts_ptr->rt_prio, strerror(errno));
+    }
+    output(info_lvl, "running with SCHED_FIFO priority %d", gen_opts_ptr->rt_prio);
+  }
+}
+
+void lock_memory(const struct general_options *gen_opts_ptr)
+{
+  if(gen_opts_ptr->lock_mem){
+    if(mlockall(MCL_CURRENT | MCL_FUTURE) == -1){
+      output(erro_lvl, "failure locking memory: %s", strerror(errno));
+    }
+    prefault_stack();
+    output(info_lvl, "memory locked");
+  }
+}
+
+void prefault_buffer(void *buff, size_t size)
+{
+  volatile char *ptr = (volatile char *) buff;
+  size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+  for(size_t i = 0; i < size; i += page_size){
+    ptr[i] = ptr[i];
+  }
+}
+
+/* stats */
+void print_ctx_switches(void)
+{
+  struct rusage usage;
+  if(getrusage(RUSAGE_SELF, &usage) == 0){
+    output(info_lvl, "context switches: %ld voluntary, %ld involuntary",
+	   usage.ru_nvcsw, usage.ru_nivcsw);
+  }
+}
+
+/* helper functions */
+static int parse_cpu_list(const char *list, cpu_set_t *cpus_ptr)
+{
+  const char *ptr = list;
+  char *end_ptr;
+  long first, last;
+
+  CPU_ZERO(cpus_ptr);
+  while(*ptr){
+    errno = 0;
+    first = strtol(ptr, &end_ptr, 10);
+    if((end_ptr == ptr) || errno || (first < 0) || (first >= CPU_SETSIZE)){
+      return 0;
+    }
+    last = first;
+    ptr = end_ptr;
+    if(*ptr == '-'){
+      ptr++;
+      last = strtol(ptr, &end_ptr, 10);
+      if((end_ptr == ptr) || errno || (last < first) || (last >= CPU_SETSIZE)){
+	return 0;
+      }
+      ptr = end_ptr;
+    }
+    for(long cpu = first; cpu <= last; cpu++){
+      CPU_SET((int) cpu, cpus_ptr);
+    }
+    if(*ptr == ','){
+      ptr++;
+    }else if(*ptr){
+      return 0;
+    }
+  }
+  return CPU_COUNT(cpus_ptr) > 0;
+}
+
+static void prefault_stack(void)
+{
+  char stack[PREFAULT_STACK_SIZE];
+  prefault_buffer(stack, sizeof(stack));
+}
@@ -0,0 +1,18 @@
+#ifndef PSP_COMMON_RT_H
+#define PSP_COMMON_RT_H
+
+/* C standard library headers */
+#include <stddef.h>
+
+/* PSP Common headers */
+#include "options.h"
+
+/* real-time profile management functions */
+void apply_rt_options(const struct general_options *);
+void lock_memory(const struct general_options *);
+void prefault_buffer(void *, size_t);
+
+/* stats */
+void print_ctx_switches(void);
+
+#endif /* PSP_COMMON_RT_H */
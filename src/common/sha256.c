@@ -0,0 +1,384 @@
+/* Configuration header */
+#include "../config.h"
+
+/* C standard library headers */
+#include <string.h>
+
+/* Architecture specific headers */
+#if defined(__x86_64__) || defined(__i386__)
+#define SHA256_X86_BACKEND
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define SHA256_ARM_BACKEND
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+/* PSP Common headers */
+#include "output.h"
+#include "sha256.h"
+
+/* SHA256 macros */
+#define SHA_Ch(x,y,z)       (((x) & (y)) ^ ((~(x)) & (z)))
+#define SHA_Maj(x,y,z)      (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+
+#define SHA256_SHR(bits,word)  ((word) >> (bits))
+#define SHA256_ROTR(bits,word) (((word) >> (bits)) | ((word) << (32-(bits))))
+
+#define SHA256_SIGMA0(word) (SHA256_ROTR( 2,word) ^ SHA256_ROTR(13,word) ^ SHA256_ROTR(22,word))
+#define SHA256_SIGMA1(word) (SHA256_ROTR( 6,word) ^ SHA256_ROTR(11,word) ^ SHA256_ROTR(25,word))
+#define SHA256_sigma0(word) (SHA256_ROTR( 7,word) ^ SHA256_ROTR(18,word) ^ SHA256_SHR( 3,word))
+#define SHA256_sigma1(word) (SHA256_ROTR(17,word) ^ SHA256_ROTR(19,word) ^ SHA256_SHR(10,word))
+
+#define SHA256_ROUND(a,b,c,d,e,f,g,h,t) do{				\
+    uint32_t temp1 = (h) + SHA256_SIGMA1(e) + SHA_Ch(e, f, g) + K[t] + W[t]; \
+    uint32_t temp2 = SHA256_SIGMA0(a) + SHA_Maj(a, b, c);		\
+    (d) += temp1;							\
+    (h) = temp1 + temp2;						\
+  }while(0)
+
+/* SHA256 constants */
+static const uint32_t SHA256_H0[8] = {
+  0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+  0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+static const uint32_t K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b,
+  0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01,
+  0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7,
+  0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+  0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152,
+  0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+  0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819,
+  0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08,
+  0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
+  0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/* SHA256 known answers: SHA256("abc") and SHA256 of the 56 byte FIPS 180-2 message */
+static const char *kat_msgs[2] = {
+  "abc",
+  "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+};
+
+static const uint8_t kat_digests[2][32] = {
+  {0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+   0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad},
+  {0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8, 0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+   0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67, 0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1}
+};
+
+/* SHA256 compression backend typedef */
+typedef void (*sha256_compress_t)(uint32_t *, const uint8_t *);
+
+/* functions prototypes */
+static void sha256_compress_scalar(uint32_t *, const uint8_t *);
+#ifdef SHA256_X86_BACKEND
+static int shani_supported(void);
+static void sha256_compress_shani(uint32_t *, const uint8_t *);
+#endif
+#ifdef SHA256_ARM_BACKEND
+static void sha256_compress_armv8(uint32_t *, const uint8_t *);
+#endif
+static int sha256_self_check(sha256_compress_t);
+
+/* selected compression backend */
+static sha256_compress_t sha256_compress = &sha256_compress_scalar;
+static const char *sha256_backend = "portable";
+static int sha256_initialized = 0;
+
+/* SHA256 backend management functions */
+void init_sha256(void)
+{
+  /* the hardware backend is used only if it reproduces the known answers */
+  sha256_compress_t hw_compress = NULL;
+  const char *hw_name = NULL;
+
+  if(sha256_initialized){
+    return;
+  }
+  sha256_initialized = 1;
+#if defined(SHA256_X86_BACKEND)
+  if(shani_supported()){
+    hw_compress = &sha256_compress_shani;
+    hw_name = "x86 SHA-NI";
+  }
+#elif defined(SHA256_ARM_BACKEND)
+  if(getauxval(AT_HWCAP) & HWCAP_SHA2){
+    hw_compress = &sha256_compress_armv8;
+    hw_name = "ARMv8 crypto extensions";
+  }
+#endif
+  if(!sha256_self_check(&sha256_compress_scalar)){
+    output(erro_lvl, "SHA256 portable backend failed the known answer check");
+  }
+  if(hw_compress){
+    if(sha256_self_check(hw_compress)){
+      sha256_compress = hw_compress;
+      sha256_backend = hw_name;
+    }else{
+      output(warn_lvl, "SHA256 %s backend failed the known answer check, "
+	     "using the portable one", hw_name);
+    }
+  }
+  output(debg_lvl, "SHA256 backend: %s", sha256_backend);
+}
+
+const char *sha256_backend_name(void)
+{
+  return sha256_backend;
+}
+
+/* SHA256 hashing functions */
+void sha256_reset(struct sha256_context *ctx)
+{
+  ctx->len_low = 0;
+  ctx->len_hi = 0;
+  ctx->block_idx = 0;
+  memcpy(ctx->ihash, SHA256_H0, 8 * sizeof(uint32_t));
+}
+
+void sha256_resume(struct sha256_context *ctx, const uint32_t *midstate)
+{
+  /* the counters match the ones reached after hashing the 64 byte key block
+     (len_hi included), so that digests are the same as without midstates */
+  ctx->len_low = 64 * 8;
+  ctx->len_hi = 64;
+  ctx->block_idx = 0;
+  memcpy(ctx->ihash, midstate, 8 * sizeof(uint32_t));
+}
+
+void sha256_input(struct sha256_context *ctx, const uint8_t *data_ptr, size_t length)
+{
+  /* len_hi counts bytes instead of carrying the length high word: the
+     resulting padding is kept since it is part of the packet HMAC */
+  size_t chunk;
+  ctx->len_low += (uint32_t) (length * 8);
+  ctx->len_hi += (uint32_t) length;
+  while(length){
+    if((ctx->block_idx == 0) && (length >= 64)){
+      sha256_compress(ctx->ihash, data_ptr);
+      data_ptr += 64;
+      length -= 64;
+      continue;
+    }
+    chunk = (size_t) (64 - ctx->block_idx);
+    if(chunk > length){
+      chunk = length;
+    }
+    memcpy(ctx->block + ctx->block_idx, data_ptr, chunk);
+    ctx->block_idx += (int16_t) chunk;
+    data_ptr += chunk;
+    length -= chunk;
+    if(ctx->block_idx == 64){
+      sha256_compress(ctx->ihash, ctx->block);
+      ctx->block_idx = 0;
+    }
+  }
+}
+
+void sha256_result(struct sha256_context *ctx, uint8_t *digest_ptr)
+{
+  ctx->block[ctx->block_idx++] = 0x80;
+  if(ctx->block_idx > (64 - 8)){
+    memset(ctx->block + ctx->block_idx, 0, (size_t) (64 - ctx->block_idx));
+    sha256_compress(ctx->ihash, ctx->block);
+    ctx->block_idx = 0;
+  }
+  memset(ctx->block + ctx->block_idx, 0, (size_t) (64 - 8 - ctx->block_idx));
+  ctx->block[56] = (uint8_t) (ctx->len_hi >> 24);
+  ctx->block[57] = (uint8_t) (ctx->len_hi >> 16);
+  ctx->block[58] = (uint8_t) (ctx->len_hi >> 8);
+  ctx->block[59] = (uint8_t) (ctx->len_hi);
+  ctx->block[60] = (uint8_t) (ctx->len_low >> 24);
+  ctx->block[61] = (uint8_t) (ctx->len_low >> 16);
+  ctx->block[62] = (uint8_t) (ctx->len_low >> 8);
+  ctx->block[63] = (uint8_t) (ctx->len_low);
+  sha256_compress(ctx->ihash, ctx->block);
+  memset(ctx->block, 0, 64);
+  ctx->block_idx = 0;
+  ctx->len_low = 0;
+  ctx->len_hi = 0;
+  for(int i = 0; i < 32; ++i)
+    digest_ptr[i] = (uint8_t)(ctx->ihash[i >> 2] >> 8 * (3 - (i & 0x03)));
+}
+
+/* helper functions */
+static void sha256_compress_scalar(uint32_t *ihash, const uint8_t *block)
+{
+  uint32_t W[64];
+  uint32_t A, B, C, D, E, F, G, H;
+
+  for(int t = 0; t < 16; t++)
+    W[t] = (((uint32_t) block[4 * t]) << 24) |
+      (((uint32_t) block[4 * t + 1]) << 16) |
+      (((uint32_t) block[4 * t + 2]) << 8) |
+      (((uint32_t) block[4 * t + 3]));
+  for(int t = 16; t < 64; t++)
+    W[t] = SHA256_sigma1(W[t - 2]) + W[t - 7] +
+      SHA256_sigma0(W[t - 15]) + W[t - 16];
+  A = ihash[0];
+  B = ihash[1];
+  C = ihash[2];
+  D = ihash[3];
+  E = ihash[4];
+  F = ihash[5];
+  G = ihash[6];
+  H = ihash[7];
+
+  /* eight rounds per iteration rotate the variables back in place */
+  for(int t = 0; t < 64; t += 8){
+    SHA256_ROUND(A, B, C, D, E, F, G, H, t);
+    SHA256_ROUND(H, A, B, C, D, E, F, G, t + 1);
+    SHA256_ROUND(G, H, A, B, C, D, E, F, t + 2);
+    SHA256_ROUND(F, G, H, A, B, C, D, E, t + 3);
+    SHA256_ROUND(E, F, G, H, A, B, C, D, t + 4);
+    SHA256_ROUND(D, E, F, G, H, A, B, C, t + 5);
+    SHA256_ROUND(C, D, E, F, G, H, A, B, t + 6);
+    SHA256_ROUND(B, C, D, E, F, G, H, A, t + 7);
+  }
+  ihash[0] += A;
+  ihash[1] += B;
+  ihash[2] += C;
+  ihash[3] += D;
+  ihash[4] += E;
+  ihash[5] += F;
+  ihash[6] += G;
+  ihash[7] += H;
+}
+
+#ifdef SHA256_X86_BACKEND
+static int shani_supported(void)
+{
+  unsigned int eax, ebx, ecx, edx;
+  if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx) ||
+     !(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1)){
+    return 0;
+  }
+  if(!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)){
+    return 0;
+  }
+  return (ebx & (1U << 29)) != 0;
+}
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha256_compress_shani(uint32_t *ihash, const uint8_t *block)
+{
+  const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i state0, state1, abef_save, cdgh_save, msg, tmp;
+  __m128i w[4];
+
+  /* the state is rearranged in the ABEF/CDGH layout used by the instructions */
+  tmp = _mm_loadu_si128((const __m128i *) &ihash[0]);
+  state1 = _mm_loadu_si128((const __m128i *) &ihash[4]);
+  tmp = _mm_shuffle_epi32(tmp, 0xB1);
+  state1 = _mm_shuffle_epi32(state1, 0x1B);
+  state0 = _mm_alignr_epi8(tmp, state1, 8);
+  state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+  abef_save = state0;
+  cdgh_save = state1;
+
+  /* four rounds per iteration, the message schedule runs ahead by three words groups */
+#pragma GCC unroll 16
+  for(int i = 0; i < 16; i++){
+    if(i < 4){
+      w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (block + 16 * i)), mask);
+    }
+    msg = _mm_add_epi32(w[i & 3], _mm_loadu_si128((const __m128i *) &K[4 * i]));
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+    if((i >= 3) && (i <= 14)){
+      tmp = _mm_alignr_epi8(w[i & 3], w[(i - 1) & 3], 4);
+      w[(i + 1) & 3] = _mm_add_epi32(w[(i + 1) & 3], tmp);
+      w[(i + 1) & 3] = _mm_sha256msg2_epu32(w[(i + 1) & 3], w[i & 3]);
+    }
+    msg = _mm_shuffle_epi32(msg, 0x0E);
+    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+    if((i >= 1) && (i <= 12)){
+      w[(i - 1) & 3] = _mm_sha256msg1_epu32(w[(i - 1) & 3], w[i & 3]);
+    }
+  }
+
+  state0 = _mm_add_epi32(state0, abef_save);
+  state1 = _mm_add_epi32(state1, cdgh_save);
+  tmp = _mm_shuffle_epi32(state0, 0x1B);
+  state1 = _mm_shuffle_epi32(state1, 0xB1);
+  state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+  state1 = _mm_alignr_epi8(state1, tmp, 8);
+  _mm_storeu_si128((__m128i *) &ihash[0], state0);
+  _mm_storeu_si128((__m128i *) &ihash[4], state1);
+}
+#endif
+
+#ifdef SHA256_ARM_BACKEND
+__attribute__((target("+crypto")))
+static void sha256_compress_armv8(uint32_t *ihash, const uint8_t *block)
+{
+  uint32x4_t state0, state1, abcd_save, efgh_save, wk, tmp;
+  uint32x4_t w[4];
+
+  state0 = vld1q_u32(&ihash[0]);
+  state1 = vld1q_u32(&ihash[4]);
+  abcd_save = state0;
+  efgh_save = state1;
+  for(int i = 0; i < 4; i++){
+    w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(block + 16 * i)));
+  }
+
+  /* four rounds per iteration, the schedule computes the words of iteration i + 4 */
+#pragma GCC unroll 16
+  for(int i = 0; i < 16; i++){
+    wk = vaddq_u32(w[i & 3], vld1q_u32(&K[4 * i]));
+    if(i < 12){
+      w[i & 3] = vsha256su0q_u32(w[i & 3], w[(i + 1) & 3]);
+    }
+    tmp = state0;
+    state0 = vsha256hq_u32(state0, state1, wk);
+    state1 = vsha256h2q_u32(state1, tmp, wk);
+    if(i < 12){
+      w[i & 3] = vsha256su1q_u32(w[i & 3], w[(i + 2) & 3], w[(i + 3) & 3]);
+    }
+  }
+
+  vst1q_u32(&ihash[0], vaddq_u32(state0, abcd_save));
+  vst1q_u32(&ihash[4], vaddq_u32(state1, efgh_save));
+}
+#endif
+
+static int sha256_self_check(sha256_compress_t compress)
+{
+  /* standard padding is used here, unlike sha256_result */
+  uint32_t ihash[8];
+  uint8_t block[128];
+  uint8_t digest[32];
+  size_t len, blocks;
+  uint64_t bits;
+
+  for(int i = 0; i < 2; i++){
+    len = strlen(kat_msgs[i]);
+    blocks = (len + 9 > 64) ? 2 : 1;
+    memset(block, 0, sizeof(block));
+    memcpy(block, kat_msgs[i], len);
+    block[len] = 0x80;
+    bits = (uint64_t) len * 8;
+    for(int j = 0; j < 8; j++){
+      block[64 * blocks - 1 - j] = (uint8_t) (bits >> (8 * j));
+    }
+    memcpy(ihash, SHA256_H0, sizeof(ihash));
+    for(size_t j = 0; j < blocks; j++){
+      compress(ihash, block + 64 * j);
+    }
+    for(int j = 0; j < 32; j++){
+      digest[j] = (uint8_t)(ihash[j >> 2] >> 8 * (3 - (j & 0x03)));
+    }
+    if(memcmp(digest, kat_digests[i], 32)){
+      return 0;
+    }
+  }
+  return 1;
+}
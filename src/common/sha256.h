@@ -0,0 +1,28 @@
+#ifndef PSP_COMMON_SHA256_H
+#define PSP_COMMON_SHA256_H
+
+/* C standard library headers */
+#include <stddef.h>
+#include <stdint.h>
+
+/* SHA256 context data structure */
+struct sha256_context
+{
+  uint32_t ihash[8];
+  uint32_t len_low;
+  uint32_t len_hi;
+  int16_t block_idx;
+  uint8_t block[64];
+};
+
+/* SHA256 backend management functions */
+void init_sha256(void);
+const char *sha256_backend_name(void);
+
+/* SHA256 hashing functions */
+void sha256_reset(struct sha256_context *);
+void sha256_resume(struct sha256_context *, const uint32_t *);
+void sha256_input(struct sha256_context *, const uint8_t *, size_t);
+void sha256_result(struct sha256_context *, uint8_t *);
+
+#endif /* PSP_COMMON_SHA256_H */
@@ -0,0 +1,135 @@
+/* C standard library headers */
+#include <errno.h>
+#include <string.h>
+
+/* POSIX library headers */
+#include <poll.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/* Linux headers */
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+
+/* PSP Common headers */
+#include "sock_ts.h"
+
+/* control message buffer */
+union ts_cmsg_buff
+{
+  char buf[CMSG_SPACE(sizeof(struct scm_timestamping)) +
+	   CMSG_SPACE(sizeof(struct sock_extended_err) + 64)];
+  struct cmsghdr align;
+};
+
+/* socket timestamping functions */
+int read_ts_cmsg(struct msghdr *msg_ptr, struct timespec *ts_ptr)
+{
+  struct cmsghdr *cmsg;
+  for(cmsg = CMSG_FIRSTHDR(msg_ptr); cmsg; cmsg = CMSG_NXTHDR(msg_ptr, cmsg)){
+    if(cmsg->cmsg_level != SOL_SOCKET){
+      continue;
+    }
+    if(cmsg->cmsg_type == SCM_TIMESTAMPING){
+      struct scm_timestamping tss;
+      memcpy(&tss, CMSG_DATA(cmsg), sizeof(tss));
+      if(tss.ts[0].tv_sec || tss.ts[0].tv_nsec){
+	*ts_ptr = tss.ts[0];
+	return 1;
+      }
+    }else if(cmsg->cmsg_type == SCM_TIMESTAMPNS){
+      memcpy(ts_ptr, CMSG_DATA(cmsg), sizeof(*ts_ptr));
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int enable_tx_timestamps(int socket_desc)
+{
+  int ts_flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+    SOF_TIMESTAMPING_OPT_TSONLY | SOF_TIMESTAMPING_OPT_ID;
+  return setsockopt(socket_desc, SOL_SOCKET, SO_TIMESTAMPING,
+		    &ts_flags, sizeof(ts_flags)) == 0;
+}
+
+int disable_tx_timestamps(int socket_desc)
+{
+  int ts_flags = 0;
+  return setsockopt(socket_desc, SOL_SOCKET, SO_TIMESTAMPING,
+		    &ts_flags, sizeof(ts_flags)) == 0;
+}
+
+void drain_tx_timestamps(int socket_desc)
+{
+  struct msghdr msg;
+  union ts_cmsg_buff ctrl;
+  do{
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+  }while(recvmsg(socket_desc, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) != -1);
+}
+
+int read_tx_timestamp(int socket_desc, struct timespec *ts_ptr, uint32_t *id_ptr, int timeout_ms)
+{
+  struct pollfd pfd;
+  struct msghdr msg;
+  union ts_cmsg_buff ctrl;
+  int res;
+
+  pfd.fd = socket_desc;
+  pfd.events = POLLPRI;
+  pfd.revents = 0;
+  do{
+    res = poll(&pfd, 1, timeout_ms);
+  }while((res == -1) && (errno == EINTR));
+  if((res <= 0) || !(pfd.revents & POLLERR)){
+    return 0;
+  }
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_control = ctrl.buf;
+  msg.msg_controllen = sizeof(ctrl.buf);
+  if(recvmsg(socket_desc, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1){
+    return 0;
+  }
+  if(id_ptr){
+    /* the extended error carries the per-socket counter of the timestamped packet */
+    struct cmsghdr *cmsg;
+    for(cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)){
+      if(((cmsg->cmsg_level == SOL_IP) && (cmsg->cmsg_type == IP_RECVERR)) ||
+	 ((cmsg->cmsg_level == SOL_IPV6) && (cmsg->cmsg_type == IPV6_RECVERR))){
+	struct sock_extended_err serr;
+	memcpy(&serr, CMSG_DATA(cmsg), sizeof(serr));
+	if(serr.ee_origin == SO_EE_ORIGIN_TIMESTAMPING){
+	  *id_ptr = serr.ee_data;
+	  break;
+	}
+      }
+    }
+    if(!cmsg){
+      return 0;
+    }
+  }
+  return read_ts_cmsg(&msg, ts_ptr);
+}
+
+/* scheduled transmission functions */
+int enable_txtime(int socket_desc, clockid_t clock_id)
+{
+  struct sock_txtime txtime_cfg;
+  txtime_cfg.clockid = clock_id;
+  txtime_cfg.flags = 0;
+  return setsockopt(socket_desc, SOL_SOCKET, SO_TXTIME,
+		    &txtime_cfg, sizeof(txtime_cfg)) == 0;
+}
+
+void write_txtime_cmsg(struct msghdr *msg_ptr, uint64_t txtime)
+{
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg_ptr);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_TXTIME;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+  memcpy(CMSG_DATA(cmsg), &txtime, sizeof(txtime));
+}
@@ -0,0 +1,25 @@
+#ifndef PSP_COMMON_SOCK_TS_H
+#define PSP_COMMON_SOCK_TS_H
+
+/* C standard library headers */
+#include <stdint.h>
+#include <time.h>
+
+/* POSIX library headers */
+#include <sys/socket.h>
+
+/* socket timestamping functions */
+int read_ts_cmsg(struct msghdr *, struct timespec *);
+int enable_tx_timestamps(int);
+int disable_tx_timestamps(int);
+void drain_tx_timestamps(int);
+int read_tx_timestamp(int, struct timespec *, uint32_t *, int);
+
+/* control message space needed by write_txtime_cmsg */
+#define TXTIME_CMSG_SPACE CMSG_SPACE(sizeof(uint64_t))
+
+/* scheduled transmission functions */
+int enable_txtime(int, clockid_t);
+void write_txtime_cmsg(struct msghdr *, uint64_t);
+
+#endif /* PSP_COMMON_SOCK_TS_H */
@@ -3,46 +3,179 @@
 
 /* POSIX headers */
 #include <arpa/inet.h>
+#include <endian.h>
 
 /* PSP Common headers */
-#include "hmac.h"
+#include "mac.h"
 #include "timestamp.h"
 
-/* timestamp packet offset macros*/
+/* v1 timestamp packet offset macros*/
 #define TIMESTAMP_IDX_OFFSET (0)
 #define TIMESTAMP_SEC_OFFSET (sizeof(ts_pkt_idx_t))
 #define TIMESTAMP_NSEC_OFFSET (TIMESTAMP_SEC_OFFSET + sizeof(ts_sec_t))
-#define TIMESTAMP_HMAC_OFFSET (TIMESTAMP_NSEC_OFFSET + sizeof(ts_nsec_t))
+#define TIMESTAMP_TYPE_OFFSET (TIMESTAMP_NSEC_OFFSET + sizeof(ts_nsec_t))
+#define TIMESTAMP_MAC_OFFSET(T) (TIMESTAMP_TYPE_OFFSET + \
+				 ((T) == ts_pkt_sync ? 0 : sizeof(ts_type_t)))
+
+/* v2 timestamp packet offset macros, all packet types share the same header */
+#define TIMESTAMP_V2_VERSION_OFFSET (0)
+#define TIMESTAMP_V2_TYPE_OFFSET (1)
+#define TIMESTAMP_V2_FLAGS_OFFSET (2)
+#define TIMESTAMP_V2_SESSION_OFFSET (4)
+#define TIMESTAMP_V2_IDX_OFFSET (8)
+#define TIMESTAMP_V2_NSEC_OFFSET (12)
+#define TIMESTAMP_V2_SEC_OFFSET (16)
+#define TIMESTAMP_V2_FRAC_OFFSET (24)
+#define TIMESTAMP_V2_BURST_POS_OFFSET (28)
+#define TIMESTAMP_V2_BURST_SIZE_OFFSET (30)
+#define TIMESTAMP_V2_MAC_OFFSET (32)
+
+/* functions forward declarations */
+static int ts_pkt_version(const uint8_t *, size_t, const struct mac_context *);
+static size_t ts_pkt_mac_offset(int, int);
 
 /* timestamp management functions */
-size_t ts_pkt_size(int secure)
+size_t ts_pkt_size(const struct mac_context *mac_ptr, int version, int type)
+{
+  return ts_pkt_mac_offset(version, type) + (mac_ptr ? mac_trailer_size(mac_ptr) : 0);
+}
+
+int ts_pkt_type(const uint8_t *src_ptr, size_t size, const struct mac_context *mac_ptr)
 {
-  return sizeof(ts_pkt_idx_t) + sizeof(ts_sec_t) +
-    sizeof(ts_nsec_t) + (secure ? 32 : 0);
+  ts_type_t type;
+  switch(ts_pkt_version(src_ptr, size, mac_ptr)){
+  case ts_pkt_v1:
+    if(size == ts_pkt_size(mac_ptr, ts_pkt_v1, ts_pkt_sync)){
+      return ts_pkt_sync;
+    }
+    type = *(src_ptr + TIMESTAMP_TYPE_OFFSET);
+    break;
+  case ts_pkt_v2:
+    type = *(src_ptr + TIMESTAMP_V2_TYPE_OFFSET);
+    break;
+  default:
+    return -1;
+  }
+  if((type == ts_pkt_two_step_sync) || (type == ts_pkt_follow_up) ||
+     ((type == ts_pkt_sync) && (size == ts_pkt_size(mac_ptr, ts_pkt_v2, ts_pkt_sync)))){
+    return type;
+  }
+  return -1;
 }
 
-void write_ts_pkt(uint8_t *dest_ptr, int secure, ts_pkt_idx_t idx, time_t sec,
-		  long nsec, uint8_t *key_ptr)
+void write_ts_pkt(uint8_t *dest_ptr, const struct mac_context *mac_ptr, const struct ts_pkt *pkt_ptr)
 {
-  *((ts_pkt_idx_t *) (dest_ptr + TIMESTAMP_IDX_OFFSET)) = htonl((ts_pkt_idx_t) idx);
-  *((ts_sec_t *) (dest_ptr + TIMESTAMP_SEC_OFFSET)) = htonl((ts_sec_t)sec);
-  *((ts_nsec_t *) (dest_ptr + TIMESTAMP_NSEC_OFFSET)) = htonl((ts_nsec_t)nsec);
-  if(secure){
-    generate_hmac(TIMESTAMP_HMAC_OFFSET, dest_ptr + TIMESTAMP_HMAC_OFFSET,
-		  dest_ptr, key_ptr);
+  uint16_t flags = htons(pkt_ptr->flags);
+  uint32_t session_id = htonl(pkt_ptr->session_id);
+  uint32_t idx = htonl((ts_pkt_idx_t) pkt_ptr->idx);
+  uint32_t nsec = htonl((ts_nsec_t) pkt_ptr->nsec);
+  uint64_t sec = htobe64((uint64_t) pkt_ptr->sec);
+  uint32_t frac = htonl(pkt_ptr->frac);
+  uint16_t burst_pos = htons(pkt_ptr->burst_pos);
+  uint16_t burst_size = htons(pkt_ptr->burst_size);
+  uint32_t sec32;
+
+  if(pkt_ptr->version == ts_pkt_v2){
+    *(dest_ptr + TIMESTAMP_V2_VERSION_OFFSET) = (uint8_t) ts_pkt_v2;
+    *(dest_ptr + TIMESTAMP_V2_TYPE_OFFSET) = (ts_type_t) pkt_ptr->type;
+    memcpy(dest_ptr + TIMESTAMP_V2_FLAGS_OFFSET, &flags, sizeof(flags));
+    memcpy(dest_ptr + TIMESTAMP_V2_SESSION_OFFSET, &session_id, sizeof(session_id));
+    memcpy(dest_ptr + TIMESTAMP_V2_IDX_OFFSET, &idx, sizeof(idx));
+    memcpy(dest_ptr + TIMESTAMP_V2_NSEC_OFFSET, &nsec, sizeof(nsec));
+    memcpy(dest_ptr + TIMESTAMP_V2_SEC_OFFSET, &sec, sizeof(sec));
+    memcpy(dest_ptr + TIMESTAMP_V2_FRAC_OFFSET, &frac, sizeof(frac));
+    memcpy(dest_ptr + TIMESTAMP_V2_BURST_POS_OFFSET, &burst_pos, sizeof(burst_pos));
+    memcpy(dest_ptr + TIMESTAMP_V2_BURST_SIZE_OFFSET, &burst_size, sizeof(burst_size));
+  }else{
+    sec32 = htonl((ts_sec_t) pkt_ptr->sec);
+    memcpy(dest_ptr + TIMESTAMP_IDX_OFFSET, &idx, sizeof(idx));
+    memcpy(dest_ptr + TIMESTAMP_SEC_OFFSET, &sec32, sizeof(sec32));
+    memcpy(dest_ptr + TIMESTAMP_NSEC_OFFSET, &nsec, sizeof(nsec));
+    if(pkt_ptr->type != ts_pkt_sync){
+      *(dest_ptr + TIMESTAMP_TYPE_OFFSET) = (ts_type_t) pkt_ptr->type;
+    }
+  }
+  if(mac_ptr){
+    write_mac(mac_ptr, dest_ptr, ts_pkt_mac_offset(pkt_ptr->version, pkt_ptr->type));
   }
 }
 
-int read_ts_pkt(uint8_t *src_ptr, int secure, ts_pkt_idx_t *idx_ptr,
-		time_t *sec_ptr, long *nsec_ptr, uint8_t *key_ptr)
+int read_ts_pkt(uint8_t *src_ptr, size_t size, const struct mac_context *mac_ptr,
+		struct ts_pkt *pkt_ptr)
 {
-  if(secure && !verify_hmac(TIMESTAMP_HMAC_OFFSET,
-			    src_ptr + TIMESTAMP_HMAC_OFFSET,
-			    src_ptr, key_ptr)){
+  /* the format version is detected from the packet size and the version byte */
+  uint16_t flags, burst_pos, burst_size;
+  uint32_t session_id, idx, nsec, frac, sec32;
+  uint64_t sec;
+
+  pkt_ptr->type = ts_pkt_type(src_ptr, size, mac_ptr);
+  if(pkt_ptr->type == -1){
+    return 0;
+  }
+  pkt_ptr->version = ts_pkt_version(src_ptr, size, mac_ptr);
+  if(mac_ptr && !check_mac(mac_ptr, src_ptr, ts_pkt_mac_offset(pkt_ptr->version, pkt_ptr->type))){
     return 0;
   }
-  *idx_ptr = (ts_pkt_idx_t) ntohl(*((ts_pkt_idx_t *) (src_ptr + TIMESTAMP_IDX_OFFSET)));
-  *sec_ptr = (time_t) ntohl(*((ts_sec_t *) (src_ptr + TIMESTAMP_SEC_OFFSET)));
-  *nsec_ptr = (long) ntohl(*((ts_nsec_t *) (src_ptr + TIMESTAMP_NSEC_OFFSET)));
-  return 1;  
+  if(pkt_ptr->version == ts_pkt_v2){
+    memcpy(&flags, src_ptr + TIMESTAMP_V2_FLAGS_OFFSET, sizeof(flags));
+    memcpy(&session_id, src_ptr + TIMESTAMP_V2_SESSION_OFFSET, sizeof(session_id));
+    memcpy(&idx, src_ptr + TIMESTAMP_V2_IDX_OFFSET, sizeof(idx));
+    memcpy(&nsec, src_ptr + TIMESTAMP_V2_NSEC_OFFSET, sizeof(nsec));
+    memcpy(&sec, src_ptr + TIMESTAMP_V2_SEC_OFFSET, sizeof(sec));
+    memcpy(&frac, src_ptr + TIMESTAMP_V2_FRAC_OFFSET, sizeof(frac));
+    memcpy(&burst_pos, src_ptr + TIMESTAMP_V2_BURST_POS_OFFSET, sizeof(burst_pos));
+    memcpy(&burst_size, src_ptr + TIMESTAMP_V2_BURST_SIZE_OFFSET, sizeof(burst_size));
+    pkt_ptr->flags = ntohs(flags);
+    pkt_ptr->session_id = ntohl(session_id);
+    pkt_ptr->idx = (ts_pkt_idx_t) ntohl(idx);
+    pkt_ptr->sec = (time_t) be64toh(sec);
+    pkt_ptr->nsec = (long) ntohl(nsec);
+    pkt_ptr->frac = ntohl(frac);
+    pkt_ptr->burst_pos = ntohs(burst_pos);
+    pkt_ptr->burst_size = ntohs(burst_size);
+  }else{
+    memcpy(&idx, src_ptr + TIMESTAMP_IDX_OFFSET, sizeof(idx));
+    memcpy(&sec32, src_ptr + TIMESTAMP_SEC_OFFSET, sizeof(sec32));
+    memcpy(&nsec, src_ptr + TIMESTAMP_NSEC_OFFSET, sizeof(nsec));
+    pkt_ptr->flags = 0;
+    pkt_ptr->session_id = 0;
+    pkt_ptr->idx = (ts_pkt_idx_t) ntohl(idx);
+    pkt_ptr->sec = (time_t) ntohl(sec32);
+    pkt_ptr->nsec = (long) ntohl(nsec);
+    pkt_ptr->frac = 0;
+    pkt_ptr->burst_pos = 0;
+    pkt_ptr->burst_size = 1;
+  }
+  return 1;
+}
+
+ts_pkt_idx_t peek_ts_pkt_idx(const uint8_t *src_ptr, size_t size, const struct mac_context *mac_ptr)
+{
+  /* unauthenticated index, only used to discard packets before the MAC check */
+  ts_pkt_idx_t idx;
+  if(ts_pkt_version(src_ptr, size, mac_ptr) == ts_pkt_v2){
+    memcpy(&idx, src_ptr + TIMESTAMP_V2_IDX_OFFSET, sizeof(idx));
+  }else{
+    memcpy(&idx, src_ptr + TIMESTAMP_IDX_OFFSET, sizeof(idx));
+  }
+  return (ts_pkt_idx_t) ntohl(idx);
+}
+
+/* helper functions */
+static int ts_pkt_version(const uint8_t *src_ptr, size_t size, const struct mac_context *mac_ptr)
+{
+  /* v1 and v2 packet sizes never overlap for a given MAC setting */
+  if((size == ts_pkt_size(mac_ptr, ts_pkt_v1, ts_pkt_sync)) ||
+     (size == ts_pkt_size(mac_ptr, ts_pkt_v1, ts_pkt_follow_up))){
+    return ts_pkt_v1;
+  }else if((size == ts_pkt_size(mac_ptr, ts_pkt_v2, ts_pkt_sync)) &&
+	   (*(src_ptr + TIMESTAMP_V2_VERSION_OFFSET) == ts_pkt_v2)){
+    return ts_pkt_v2;
+  }
+  return -1;
+}
+
+static size_t ts_pkt_mac_offset(int version, int type)
+{
+  return (version == ts_pkt_v2) ? TIMESTAMP_V2_MAC_OFFSET : TIMESTAMP_MAC_OFFSET(type);
 }
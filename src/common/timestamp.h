@@ -2,19 +2,60 @@
 #define PSP_COMMON_TIMESTAMP_H
 
 /* C standard library headers */
+#include <stddef.h>
 #include <stdint.h>
 #include <time.h>
 
+/* PSP Common headers */
+#include "mac.h"
+
 /* timestamp packet typedefs */
 typedef uint32_t ts_pkt_idx_t;
 typedef uint32_t ts_sec_t;
 typedef uint32_t ts_nsec_t;
+typedef uint8_t ts_type_t;
+
+/* timestamp packet types enumeration */
+enum ts_pkt_type
+{
+  ts_pkt_sync = 0,
+  ts_pkt_two_step_sync = 1,
+  ts_pkt_follow_up = 2
+};
+
+/* timestamp packet format versions enumeration */
+enum ts_pkt_version
+{
+  ts_pkt_v1 = 1,
+  ts_pkt_v2 = 2
+};
+
+/* timestamp packet flags (v2 only) */
+#define TS_PKT_FLAG_KERNEL_TS (0x0001) /* timestamp taken by the kernel at transmission */
+
+/* maximum number of packets in a burst (v2 only) */
+#define TS_PKT_MAX_BURST (64)
+
+/* timestamp packet content structure */
+struct ts_pkt
+{
+  int version;
+  int type;
+  uint16_t flags;
+  uint32_t session_id;
+  ts_pkt_idx_t idx;
+  time_t sec;
+  long nsec;
+  uint32_t frac; /* nanosecond fraction in units of 2^-32 ns */
+  uint16_t burst_pos;
+  uint16_t burst_size;
+};
 
 /* timestamp management functions */
-size_t ts_pkt_size(int);
-void write_ts_pkt(uint8_t *, int, ts_pkt_idx_t,
-		  time_t, long, uint8_t *);
-int read_ts_pkt(uint8_t *, int, ts_pkt_idx_t *,
-		time_t *, long *, uint8_t *);
+size_t ts_pkt_size(const struct mac_context *, int, int);
+int ts_pkt_type(const uint8_t *, size_t, const struct mac_context *);
+void write_ts_pkt(uint8_t *, const struct mac_context *, const struct ts_pkt *);
+int read_ts_pkt(uint8_t *, size_t, const struct mac_context *, struct ts_pkt *);
+ts_pkt_idx_t peek_ts_pkt_idx(const uint8_t *, size_t, const struct mac_context *);
 
 #endif /* PSP_COMMON_TIMESTAMP_H */
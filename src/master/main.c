@@ -1,16 +1,26 @@
+/* Configuration header */
+#include "../config.h"
+
 /* C standard library headers */
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+/* POSIX library headers */
+#include <sys/socket.h>
+
 /* PSP Common headers */
 #include "../common/mgmt.h"
+#include "../common/net.h"
 #include "../common/output.h"
+#include "../common/rt.h"
+#include "../common/sock_ts.h"
 
 /* PSP Mater headers */
-#include "nonce.h"    
+#include "nonce.h"
 #include "options.h"
 #include "state.h"
 #include "timer.h"
@@ -18,6 +28,13 @@
 /* functions forward declarations */
 static void mngd_main(void *);
 static void emit_timestamp(void *);
+static long emit_pkt(struct master_state *, int);
+static void emit_follow_ups(struct master_state *, int);
+static void collect_tx_timestamps(struct master_state *, uint32_t, long);
+static void check_txtime(struct master_state *, const struct timespec *);
+static void end_txtime_checks(struct master_state *);
+static long send_pkts(struct master_state *, const struct timespec *, int);
+static void init_ts_pkt(const struct master_state *, struct ts_pkt *, int, const struct timespec *);
 
 /* main function */
 int main(int argc, char **argv)
@@ -39,50 +56,290 @@ static void mngd_main(void *ptr)
   apply_general_options(&opts_ptr->gen_opts);
   print_selected_options(opts_ptr);
   init_state_from_options(state_ptr, opts_ptr);
-  emit_timestamp(state_ptr);
-  wait_signals();
+  lock_memory(&opts_ptr->gen_opts);
+  run_scheduler(&state_ptr->sched, &emit_timestamp, state_ptr);
 }
 
 /* emit timestamp function */
 static void emit_timestamp(void *data_ptr)
 {
   struct master_state *state_ptr = (struct master_state *) data_ptr;
+  struct timespec start, next;
+  long sent = 0;
+
+  /* burst members are spaced from the burst start to avoid accumulating delays */
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(int pos = 0; pos < state_ptr->burst_size; pos++){
+    if(pos && state_ptr->burst_spacing){
+      next.tv_sec = start.tv_sec;
+      next.tv_nsec = start.tv_nsec + pos * state_ptr->burst_spacing;
+      next.tv_sec += next.tv_nsec / 1000000000L;
+      next.tv_nsec %= 1000000000L;
+      while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR);
+    }
+    sent += emit_pkt(state_ptr, pos);
+  }
+  if(sent){
+    if(state_ptr->pkt_cnt >= 0){
+      state_ptr->pkt_cnt--;
+    }
+    if(state_ptr->pkt_cnt == 0){
+      output(info_lvl, "finished emitting timestamps. Exiting...");
+      clean_exit();
+    }
+  }
+}
+
+/* emit packet function */
+static long emit_pkt(struct master_state *state_ptr, int burst_pos)
+{
   struct timespec ts;
-  long delay = state_ptr->period - state_ptr->stagger +
-    (long) (((double) (state_ptr->stagger * 2)) *
-	    (((double) rand()) / ((double) RAND_MAX + 1.0)));
+  struct ts_pkt pkt;
+  char addr_str[SOCKADDR_STR_LEN];
+  uint32_t tx_key;
+  long sent;
   errno = 0;
   if(clock_gettime(CLOCK_REALTIME, &ts) == -1){
     output(erro_lvl, "failure reading realtime clock: %s", strerror(errno));
-  }else{
-    write_ts_pkt(state_ptr->pkt_buff, state_ptr->secure, state_ptr->pkt_idx,
-		 ts.tv_sec, ts.tv_nsec, state_ptr->key);
-    errno = 0;
-    if(sendto(state_ptr->socket_desc, state_ptr->pkt_buff, state_ptr->pkt_size, 0,
-	      (struct sockaddr *)&state_ptr->slave_addr,
-	      sizeof(state_ptr->slave_addr)) == -1){
-      if((errno != EINTR) && (errno != EAGAIN)){
-	output(erro_lvl, "sendto failure: %s", strerror(errno));
-      }
+    return 0;
+  }
+  if(state_ptr->txtime){
+    /* the packet carries its launch time instead of the build time */
+    ts.tv_nsec += state_ptr->txtime_lead;
+    ts.tv_sec += ts.tv_nsec / 1000000000L;
+    ts.tv_nsec %= 1000000000L;
+  }
+  init_ts_pkt(state_ptr, &pkt, state_ptr->two_step ? ts_pkt_two_step_sync : ts_pkt_sync, &ts);
+  pkt.burst_pos = (uint16_t) burst_pos;
+  write_ts_pkt(state_ptr->dests[0].pkt_buff, state_ptr->mac_ptr, &pkt);
+  for(long i = 1; i < state_ptr->dest_cnt; i++){
+    memcpy(state_ptr->dests[i].pkt_buff, state_ptr->dests[0].pkt_buff, state_ptr->pkt_size);
+  }
+  if(state_ptr->tx_ts){
+    drain_tx_timestamps(state_ptr->socket_desc);
+  }
+  tx_key = state_ptr->tx_key;
+  sent = send_pkts(state_ptr, &ts, 0);
+  if(sent){
+    if(state_ptr->dest_cnt == 1){
+      output(info_lvl, "sending packet to %s",
+	     sockaddr_to_str(&state_ptr->dests[0].addr, addr_str, sizeof(addr_str)));
     }else{
-      output(info_lvl, "sending packet to %s:%hu",
-      	     inet_ntoa(state_ptr->slave_addr.sin_addr),
-      	     ntohs(state_ptr->slave_addr.sin_port));
-      output(debg_lvl, "idx %09lu secs: %09lu nsecs: %09lu", state_ptr->pkt_idx,
-	     ts.tv_sec, ts.tv_nsec);
-      state_ptr->pkt_idx++;
-      if(state_ptr->secure){
-	write_nonce(state_ptr->nonce_file, state_ptr->pkt_idx);
+      output(info_lvl, "sending packet to %ld of %ld slaves", sent, state_ptr->dest_cnt);
+    }
+    output(debg_lvl, "idx %09lu secs: %09lu nsecs: %09lu", state_ptr->pkt_idx,
+	   ts.tv_sec, ts.tv_nsec);
+    if(state_ptr->tx_ts){
+      collect_tx_timestamps(state_ptr, tx_key, sent);
+    }
+    if(state_ptr->txtime_checks){
+      check_txtime(state_ptr, &ts);
+    }
+    if(state_ptr->two_step){
+      emit_follow_ups(state_ptr, burst_pos);
+    }
+    state_ptr->pkt_idx++;
+    if(state_ptr->secure && (state_ptr->pkt_idx >= state_ptr->lease.end)){
+      renew_nonce_lease(&state_ptr->lease, state_ptr->pkt_idx);
+    }
+  }
+  return sent;
+}
+
+/* emit follow-ups function */
+static void emit_follow_ups(struct master_state *state_ptr, int burst_pos)
+{
+  struct destination *dest_ptr;
+  struct ts_pkt pkt;
+  for(long i = 0; i < state_ptr->dest_cnt; i++){
+    dest_ptr = &state_ptr->dests[i];
+    if(dest_ptr->tx_ts_valid){
+      init_ts_pkt(state_ptr, &pkt, ts_pkt_follow_up, &dest_ptr->tx_ts);
+      pkt.flags |= TS_PKT_FLAG_KERNEL_TS;
+      pkt.burst_pos = (uint16_t) burst_pos;
+      write_ts_pkt(dest_ptr->pkt_buff, state_ptr->mac_ptr, &pkt);
+    }
+  }
+  if(send_pkts(state_ptr, NULL, 1) && (state_ptr->dest_cnt == 1)){
+    output(debg_lvl, "follow-up idx %09lu secs: %09lu nsecs: %09lu", state_ptr->pkt_idx,
+	   state_ptr->dests[0].tx_ts.tv_sec, state_ptr->dests[0].tx_ts.tv_nsec);
+  }
+}
+
+/* collect transmit timestamps function */
+static void collect_tx_timestamps(struct master_state *state_ptr, uint32_t tx_key, long cnt)
+{
+  /* transmit timestamps are matched to destinations through the per-socket
+     packet counter, since the kernel may report them out of order */
+  struct timespec ts, first, last;
+  uint32_t id;
+  long pending = cnt;
+  long i;
+  double spread;
+
+  for(i = 0; i < state_ptr->dest_cnt; i++){
+    state_ptr->dests[i].tx_ts_valid = 0;
+  }
+  while(pending && read_tx_timestamp(state_ptr->socket_desc, &ts, &id, state_ptr->tx_ts_timeout)){
+    i = (long) (uint32_t) (id - tx_key);
+    if((i < cnt) && !state_ptr->dests[i].tx_ts_valid){
+      state_ptr->dests[i].tx_ts_valid = 1;
+      state_ptr->dests[i].tx_ts = ts;
+      pending--;
+    }
+  }
+  if(pending){
+    output(warn_lvl, "%ld transmit timestamps missing for idx %09lu%s", pending, state_ptr->pkt_idx,
+	   state_ptr->two_step ? ", follow-ups not sent" : "");
+  }
+  if((state_ptr->dest_cnt > 1) && (cnt - pending > 1)){
+    first.tv_sec = last.tv_sec = 0;
+    first.tv_nsec = last.tv_nsec = 0;
+    for(i = 0; i < cnt; i++){
+      if(!state_ptr->dests[i].tx_ts_valid){
+	continue;
+      }
+      ts = state_ptr->dests[i].tx_ts;
+      if(!first.tv_sec || (ts.tv_sec < first.tv_sec) ||
+	 ((ts.tv_sec == first.tv_sec) && (ts.tv_nsec < first.tv_nsec))){
+	first = ts;
       }
-      if(state_ptr->pkt_cnt >= 0){
-	state_ptr->pkt_cnt--;
+      if(!last.tv_sec || (ts.tv_sec > last.tv_sec) ||
+	 ((ts.tv_sec == last.tv_sec) && (ts.tv_nsec > last.tv_nsec))){
+	last = ts;
       }
-      if(state_ptr->pkt_cnt == 0){
-	output(info_lvl, "finished emitting timestamps. Exiting...");
-	clean_exit();
+    }
+    spread = (double) (last.tv_sec - first.tv_sec) +
+      (double) (last.tv_nsec - first.tv_nsec) * 1e-9;
+    output(debg_lvl, "fan-out spread idx %09lu: %.9f", state_ptr->pkt_idx, spread);
+    add_basic_stats_sample(&state_ptr->spread_bs, spread);
+  }
+}
+
+/* check scheduled launch function */
+static void check_txtime(struct master_state *state_ptr, const struct timespec *launch_ptr)
+{
+  /* a packet leaving closer to its hand-off than to its launch time shows
+     that the queueing discipline does not hold it */
+  const struct timespec *ts_ptr;
+  double early;
+  int checked = 0;
+
+  for(long i = 0; i < state_ptr->dest_cnt; i++){
+    if(!state_ptr->dests[i].tx_ts_valid){
+      continue;
+    }
+    ts_ptr = &state_ptr->dests[i].tx_ts;
+    early = (double) (launch_ptr->tv_sec - ts_ptr->tv_sec) +
+      (double) (launch_ptr->tv_nsec - ts_ptr->tv_nsec) * 1e-9;
+    if(early > (double) state_ptr->txtime_lead * 0.5e-9){
+      output(warn_lvl, "packet idx %09lu left %.6f s before its launch time, the egress "
+	     "queueing discipline ignores SO_TXTIME and the timestamps sent so far are skewed; "
+	     "falling back to user space launch", state_ptr->pkt_idx, early);
+      state_ptr->txtime = txtime_user;
+      end_txtime_checks(state_ptr);
+      return;
+    }
+    checked = 1;
+  }
+  if(checked && (--state_ptr->txtime_checks == 0)){
+    output(info_lvl, "scheduled launch honoured by the egress queueing discipline");
+    end_txtime_checks(state_ptr);
+  }
+}
+
+/* end scheduled launch checks function */
+static void end_txtime_checks(struct master_state *state_ptr)
+{
+  state_ptr->txtime_checks = 0;
+  if(!state_ptr->two_step && (state_ptr->dest_cnt == 1)){
+    if(!disable_tx_timestamps(state_ptr->socket_desc)){
+      output(erro_lvl, "failure disabling transmit timestamps on UDP socket");
+    }
+    drain_tx_timestamps(state_ptr->socket_desc);
+    state_ptr->tx_ts = 0;
+  }
+}
+
+/* send packets function */
+static long send_pkts(struct master_state *state_ptr, const struct timespec *launch_ptr,
+		      int follow_up)
+{
+  struct timespec now, tai;
+  struct msghdr *hdr_ptr;
+  int64_t lead = state_ptr->txtime_lead;
+  uint64_t txtime = 0;
+  long cnt = 0;
+  long sent = 0;
+  int res;
+
+  errno = 0;
+  if(state_ptr->txtime == txtime_kernel){
+    /* SO_TXTIME launch times are expressed on CLOCK_TAI */
+    if((clock_gettime(CLOCK_REALTIME, &now) == -1) ||
+       (clock_gettime(CLOCK_TAI, &tai) == -1)){
+      output(erro_lvl, "failure reading clocks: %s", strerror(errno));
+    }
+    if(launch_ptr){
+      lead = ((int64_t) launch_ptr->tv_sec - (int64_t) now.tv_sec) * 1000000000L +
+	(int64_t) (launch_ptr->tv_nsec - now.tv_nsec);
+    }
+    txtime = (uint64_t) ((int64_t) tai.tv_sec * 1000000000L + tai.tv_nsec + lead);
+  }else if(launch_ptr && (state_ptr->txtime == txtime_user)){
+    while(clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, launch_ptr, NULL) == EINTR);
+  }
+
+  /* one message per destination, follow-ups only where a transmit timestamp is known */
+  for(long i = 0; i < state_ptr->dest_cnt; i++){
+    if(follow_up && !state_ptr->dests[i].tx_ts_valid){
+      continue;
+    }
+    state_ptr->iovs[cnt].iov_base = state_ptr->dests[i].pkt_buff;
+    state_ptr->iovs[cnt].iov_len = state_ptr->pkt_size;
+    hdr_ptr = &state_ptr->msgs[cnt].msg_hdr;
+    hdr_ptr->msg_name = &state_ptr->dests[i].addr;
+    hdr_ptr->msg_namelen = state_ptr->dests[i].addr_len;
+    hdr_ptr->msg_iov = &state_ptr->iovs[cnt];
+    hdr_ptr->msg_iovlen = 1;
+    if(state_ptr->txtime == txtime_kernel){
+      hdr_ptr->msg_control = state_ptr->ctrl_buffs + cnt * TXTIME_CMSG_SPACE;
+      hdr_ptr->msg_controllen = TXTIME_CMSG_SPACE;
+      write_txtime_cmsg(hdr_ptr, txtime);
+    }else{
+      hdr_ptr->msg_control = NULL;
+      hdr_ptr->msg_controllen = 0;
+    }
+    cnt++;
+  }
+
+  while(sent < cnt){
+    res = sendmmsg(state_ptr->socket_desc, state_ptr->msgs + sent, (unsigned int) (cnt - sent), 0);
+    if(res == -1){
+      if((errno != EINTR) && (errno != EAGAIN)){
+	output(erro_lvl, "sendmmsg failure: %s", strerror(errno));
       }
-      output(debg_lvl, "waiting for % 6ld.%03ld seconds", delay / 1000l, delay % 1000l);
-      set_timer(delay, &emit_timestamp, state_ptr);
+      break;
     }
+    sent += res;
   }
+  if(state_ptr->tx_ts){
+    state_ptr->tx_key += (uint32_t) sent;
+  }
+  return sent;
+}
+
+/* timestamp packet content initialization function */
+static void init_ts_pkt(const struct master_state *state_ptr, struct ts_pkt *pkt_ptr, int type,
+			const struct timespec *ts_ptr)
+{
+  pkt_ptr->version = state_ptr->version;
+  pkt_ptr->type = type;
+  pkt_ptr->flags = 0;
+  pkt_ptr->session_id = state_ptr->session_id;
+  pkt_ptr->idx = state_ptr->pkt_idx;
+  pkt_ptr->sec = ts_ptr->tv_sec;
+  pkt_ptr->nsec = ts_ptr->tv_nsec;
+  pkt_ptr->frac = 0;
+  pkt_ptr->burst_pos = 0;
+  pkt_ptr->burst_size = (uint16_t) state_ptr->burst_size;
 }
@@ -1,28 +1,97 @@
+/* C standard library headers */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* POSIX library headers */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
 /* PSP Common headers */
 #include "../common/output.h"
 
 /* PSP Master headers */
 #include "nonce.h"
 
-/* nonce management functions */
-ts_pkt_idx_t read_nonce(FILE *file_ptr)
+/* functions forward declarations */
+static ts_pkt_idx_t read_nonce(int);
+static void write_nonce(int, ts_pkt_idx_t);
+
+/* nonce lease management functions */
+void init_nonce_lease(struct nonce_lease *lease_ptr, const char *filename,
+		      ts_pkt_idx_t size, ts_pkt_idx_t *idx_ptr)
+{
+  struct stat st;
+
+  lease_ptr->size = size;
+  lease_ptr->file_desc = open(filename, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+  if(lease_ptr->file_desc == -1){
+    output(erro_lvl, "cannot open nonce file '%s': %s", filename, strerror(errno));
+  }else if(fstat(lease_ptr->file_desc, &st) == -1){
+    output(erro_lvl, "failure reading nonce file '%s' status", filename);
+  }
+
+  /* the file holds the end of the last lease, i.e. the first index never issued */
+  *idx_ptr = st.st_size ? read_nonce(lease_ptr->file_desc) : 1;
+  lease_ptr->end = *idx_ptr;
+  renew_nonce_lease(lease_ptr, *idx_ptr);
+}
+
+void renew_nonce_lease(struct nonce_lease *lease_ptr, ts_pkt_idx_t idx)
 {
-  ts_pkt_idx_t res;
-  if(fscanf(file_ptr, "%09u", &res) != 1){
+  /* the new lease is made durable before any of its indices is issued */
+  if(idx == UINT32_MAX){
+    output(erro_lvl, "nonce space exhausted, a new key is needed");
+  }
+  lease_ptr->end = (idx > UINT32_MAX - lease_ptr->size) ? UINT32_MAX : idx + lease_ptr->size;
+  write_nonce(lease_ptr->file_desc, lease_ptr->end);
+  output(debg_lvl, "nonce lease renewed up to %09u", lease_ptr->end);
+}
+
+void fini_nonce_lease(struct nonce_lease *lease_ptr, ts_pkt_idx_t idx)
+{
+  /* on clean exit the unused part of the lease is given back */
+  if(lease_ptr->file_desc != -1){
+    write_nonce(lease_ptr->file_desc, idx);
+    if(close(lease_ptr->file_desc) == -1){
+      output(erro_lvl, "failure closing nonce file");
+    }
+    lease_ptr->file_desc = -1;
+  }
+}
+
+/* helper functions */
+static ts_pkt_idx_t read_nonce(int file_desc)
+{
+  char buff[16];
+  char *end_ptr;
+  ssize_t len;
+  unsigned long res;
+
+  len = pread(file_desc, buff, sizeof(buff) - 1, 0);
+  if(len <= 0){
     output(erro_lvl, "failure reading nonce from nonce file");
-  }else{
-    rewind(file_ptr);
   }
-  return res;
+  buff[len] = '\0';
+  errno = 0;
+  res = strtoul(buff, &end_ptr, 10);
+  if(errno || (end_ptr == buff) || (res > UINT32_MAX)){
+    output(erro_lvl, "invalid nonce in nonce file");
+  }
+  return (ts_pkt_idx_t) res;
 }
 
-void write_nonce(FILE *file_ptr, ts_pkt_idx_t idx)
+static void write_nonce(int file_desc, ts_pkt_idx_t idx)
 {
-  if(fprintf(file_ptr, "%09u", idx) < 0){
+  char buff[16];
+  int len = snprintf(buff, sizeof(buff), "%09u", idx);
+  if((pwrite(file_desc, buff, (size_t) len, 0) != len) ||
+     (ftruncate(file_desc, len) == -1)){
     output(erro_lvl, "failure writing nonce to file");
-  }else if(fflush(file_ptr)){
-    output(erro_lvl, "failure flushing nonce file");
-  }else{
-    rewind(file_ptr);
+  }else if(fsync(file_desc) == -1){
+    output(erro_lvl, "failure syncing nonce file");
   }
 }
@@ -1,14 +1,20 @@
 #ifndef PSPM_NONCE_H
 #define PSPM_NONCE_H
 
-/* C standard library headers */
-#include <stdio.h>
-
 /* PSP Common headers */
 #include "../common/timestamp.h"
 
-/* nonce management functions */
-ts_pkt_idx_t read_nonce(FILE *);
-void write_nonce(FILE *, ts_pkt_idx_t);
+/* nonce lease structure */
+struct nonce_lease
+{
+  int file_desc;
+  ts_pkt_idx_t size;
+  ts_pkt_idx_t end;
+};
+
+/* nonce lease management functions */
+void init_nonce_lease(struct nonce_lease *, const char *, ts_pkt_idx_t, ts_pkt_idx_t *);
+void renew_nonce_lease(struct nonce_lease *, ts_pkt_idx_t);
+void fini_nonce_lease(struct nonce_lease *, ts_pkt_idx_t);
 
 #endif /* PSPM_NONCE_H */
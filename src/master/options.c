@@ -1,9 +1,13 @@
 /* C standard library headers */
 #include "limits.h"
+#include "stdint.h"
 #include "stdio.h"
+#include "string.h"
 
 /* PSP Common headers */
+#include "../common/net.h"
 #include "../common/output.h"
+#include "../common/timestamp.h"
 
 /* PSP Master headers */
 #include "options.h"
@@ -15,29 +19,56 @@ static int custom_option_checks(struct option_descriptor *);
 int parse_command_line(int argc, char **argv, struct options *opts_ptr)
 {
   init_general_options(&opts_ptr->gen_opts);
-  opts_ptr->slave_addr.sin_family = AF_INET;
-  opts_ptr->slave_addr.sin_port = htons(4242);
+  memset(&opts_ptr->slave_addr, 0, sizeof(opts_ptr->slave_addr));
+  opts_ptr->slave_addr.ss_family = AF_INET;
+  opts_ptr->slave_port = htons(4242);
+  opts_ptr->slave_list_filename = NULL;
   opts_ptr->bcast_enabled = 0;
+  opts_ptr->hops = -1;
+  opts_ptr->ifname = NULL;
+  opts_ptr->no_loopback = 0;
   opts_ptr->period = 1000;
   opts_ptr->stagger = 250;
   opts_ptr->max_pkt_cnt = -1;
+  opts_ptr->two_step = 0;
+  opts_ptr->txtime_lead = -1;
+  opts_ptr->burst_size = 1;
+  opts_ptr->burst_spacing = 0;
+  opts_ptr->version = ts_pkt_v1;
+  opts_ptr->session_id = 0;
   opts_ptr->tos = -1;
   opts_ptr->key_filename = NULL;
   opts_ptr->nonce_filename = NULL;
+  opts_ptr->lease_size = 10000;
+  init_mac_spec(&opts_ptr->mac_spec);
 
   const struct num_bounds period_bounds = {0, 86400000};
   const struct num_bounds stagger_bounds = {0, 86399999};
   const struct num_bounds pkt_cnt_bounds = {1, LONG_MAX};
   const struct num_bounds tos_bounds = {0, 255};
+  const struct num_bounds hops_bounds = {1, 255};
+  const struct num_bounds txtime_lead_bounds = {1, 1000000};
+  const struct num_bounds lease_size_bounds = {1, 100000000};
+  const struct num_bounds burst_size_bounds = {2, TS_PKT_MAX_BURST};
+  const struct num_bounds burst_spacing_bounds = {0, 1000000};
+  const struct num_bounds version_bounds = {ts_pkt_v1, ts_pkt_v2};
+  const struct num_bounds session_id_bounds = {0, UINT32_MAX};
 
   struct option_descriptor optreg[] =
     { /* general options */
      GEN_OPTS(opts_ptr->gen_opts),
      
      /* destination options */
-     IN_ADDR_OPT('a', "<IP address>, specifies the slave IP address", &opts_ptr->slave_addr.sin_addr, "*", ""),
+     SOCKADDR_OPT('a', "<IP address>, specifies the slave IPv4 or IPv6 address, or the multicast group", &opts_ptr->slave_addr, "", "F"),
+     STR_OPT('F', "<filename>, specifies a file listing the slave addresses, one per line with optional port",
+	     &opts_ptr->slave_list_filename, "", "a"),
      FLAG_OPT('b', "enables broadcast of timestamp packets", &opts_ptr->bcast_enabled, "", ""),
-     IN_PORT_OPT('p', "<port number>, specifies the slave UDP port", &opts_ptr->slave_addr.sin_port, "", ""),
+     IN_PORT_OPT('p', "<port number>, specifies the slave UDP port", &opts_ptr->slave_port, "", ""),
+
+     /* multicast options */
+     BND_INT_OPT('m', "<integer>, specifies the TTL or hop limit of timestamp packets", &opts_ptr->hops, &hops_bounds, "", ""),
+     STR_OPT('i', "<interface>, specifies the interface of outgoing multicast packets", &opts_ptr->ifname, "", ""),
+     FLAG_OPT('x', "disables the loopback of outgoing multicast packets", &opts_ptr->no_loopback, "", ""),
 
      /* timestamp transmission options */
      BND_LONG_OPT('d', "<integer>, specifies timestamp transmission "
@@ -48,6 +79,19 @@ int parse_command_line(int argc, char **argv, struct options *opts_ptr)
 		  "", ""),
      BND_LONG_OPT('n', "<integer>, specifies the number of timestamp packets to emit before stopping",
 		  &opts_ptr->max_pkt_cnt, &pkt_cnt_bounds, "", ""), 
+     FLAG_OPT('f', "enables two-step transmission with follow-up packets", &opts_ptr->two_step, "", ""),
+     BND_LONG_OPT('e', "<integer>, enables scheduled launch and specifies the launch lead time in us",
+		  &opts_ptr->txtime_lead, &txtime_lead_bounds, "", ""),
+     BND_INT_OPT('B', "<integer>, enables burst transmission and specifies the number of packets per burst (value between 2 and 64)",
+		 &opts_ptr->burst_size, &burst_size_bounds, "V", ""),
+     BND_LONG_OPT('G', "<integer>, specifies the spacing between packets of a burst in us",
+		  &opts_ptr->burst_spacing, &burst_spacing_bounds, "B", ""),
+
+     /* packet format options */
+     BND_INT_OPT('V', "<integer>, specifies the timestamp packet format version (1 or 2)",
+		 &opts_ptr->version, &version_bounds, "", ""),
+     BND_LONG_OPT('I', "<integer>, specifies the master session identifier carried by version 2 packets",
+		  &opts_ptr->session_id, &session_id_bounds, "V", ""),
 
      /* QoS options */
      BND_INT_OPT('t', "<integer>, specifies timestamp packets TOS field", &opts_ptr->tos, &tos_bounds, "", ""),
@@ -55,14 +99,20 @@ int parse_command_line(int argc, char **argv, struct options *opts_ptr)
      /* secure protocol options */
      STR_OPT('k', "<filename>, specifies the cryptographic key for timestamp authentication", &opts_ptr->key_filename, "o", ""),
      STR_OPT('o', "<filename>, specifies the nonce file name", &opts_ptr->nonce_filename, "k", ""),
+     BND_LONG_OPT('N', "<integer>, specifies the number of nonces reserved at each nonce file update",
+		  &opts_ptr->lease_size, &lease_size_bounds, "k", ""),
+     MAC_OPT('M', "<algorithm[:tag length]>, specifies the packet MAC (hmac-sha256, siphash or blake2s) "
+	     "and its tag length in bytes", &opts_ptr->mac_spec, "k", ""),
 
      /* end of options */
      END_OPTS};
 
   struct opt_group optg[] = {GEN_OPTS_GROUP,
-			     OPTS_GROUP("destination options", "abp"),
-			     OPTS_GROUP("timestamp transmission options", "dsnt"),
-			     OPTS_GROUP("secure protocol options", "ko"),
+			     OPTS_GROUP("destination options", "aFbp"),
+			     OPTS_GROUP("multicast options", "mix"),
+			     OPTS_GROUP("timestamp transmission options", "dsnfeBGt"),
+			     OPTS_GROUP("packet format options", "VI"),
+			     OPTS_GROUP("secure protocol options", "koNM"),
 			     END_OPTS_GROUP};
 
   if(parse_opts(optreg, argc, argv) &&
@@ -83,21 +133,68 @@ static int custom_option_checks(struct option_descriptor *optreg)
 {
   struct option_descriptor *period_opt = find_opt_desc(optreg, 'd');
   struct option_descriptor *stagger_opt = find_opt_desc(optreg, 's');
+  struct option_descriptor *addr_opt = find_opt_desc(optreg, 'a');
+  struct option_descriptor *version_opt = find_opt_desc(optreg, 'V');
+  const struct sockaddr_storage *addr_ptr = (const struct sockaddr_storage *) addr_opt->trgt;
   if(*((long *) period_opt->trgt) <= *((long *) stagger_opt->trgt)){
     printf("stagger shall be strictly smaller than period\n");
     return 0;
   }
+  if(!is_opt_set(optreg, 'a') && !is_opt_set(optreg, 'F')){
+    printf("either the slave address or the slave list file shall be specified\n");
+    return 0;
+  }
+  /* with a slave list these checks run on the loaded destinations */
+  if(is_opt_set(optreg, 'a') && is_opt_set(optreg, 'b') && (addr_ptr->ss_family != AF_INET)){
+    printf("broadcast is not available with IPv6 addresses\n");
+    return 0;
+  }
+  if(is_opt_set(optreg, 'a') && (is_opt_set(optreg, 'i') || is_opt_set(optreg, 'x')) &&
+     !is_multicast_sockaddr(addr_ptr)){
+    printf("multicast options require a multicast slave address\n");
+    return 0;
+  }
+  if(is_opt_set(optreg, 'I') && (*((int *) version_opt->trgt) != ts_pkt_v2)){
+    printf("the session identifier requires the version 2 packet format\n");
+    return 0;
+  }
+  if(is_opt_set(optreg, 'B') && (*((int *) version_opt->trgt) != ts_pkt_v2)){
+    printf("burst transmission requires the version 2 packet format\n");
+    return 0;
+  }
+  if(*((long *) find_opt_desc(optreg, 'G')->trgt) * (*((int *) find_opt_desc(optreg, 'B')->trgt) - 1) >=
+     (*((long *) period_opt->trgt) - *((long *) stagger_opt->trgt)) * 1000){
+    printf("burst duration shall be strictly smaller than period minus stagger\n");
+    return 0;
+  }
   return 1;
 }
 
 /* options reporting */
 void print_selected_options(const struct options *opts_ptr)
 {
+  char addr_str[SOCKADDR_STR_LEN];
+
   output(info_lvl, "Packet Synchronization Master started...");
   output(info_lvl, "Parameters:");
-  output(info_lvl, "  slave address        = %s", inet_ntoa(opts_ptr->slave_addr.sin_addr));
-  output(info_lvl, "  slave UDP port       = %hu", ntohs(opts_ptr->slave_addr.sin_port));
+  if(opts_ptr->slave_list_filename){
+    output(info_lvl, "  slave list file      = %s", opts_ptr->slave_list_filename);
+  }else{
+    output(info_lvl, "  slave address        = %s",
+	   sockaddr_to_str(&opts_ptr->slave_addr, addr_str, sizeof(addr_str)));
+  }
+  output(info_lvl, "  slave UDP port       = %hu", ntohs(opts_ptr->slave_port));
   output(info_lvl, "  broadcast            = %s", opts_ptr->bcast_enabled ? "enabled" : "disabled");
+  if(opts_ptr->hops != -1){
+    output(info_lvl, "  TTL/hop limit        = %d", opts_ptr->hops);
+  }else{
+    output(info_lvl, "  TTL/hop limit        = not set");
+  }
+  if(opts_ptr->slave_list_filename ? (opts_ptr->ifname || opts_ptr->no_loopback) :
+     is_multicast_sockaddr(&opts_ptr->slave_addr)){
+    output(info_lvl, "  multicast interface  = %s", opts_ptr->ifname ? opts_ptr->ifname : "default");
+    output(info_lvl, "  multicast loopback   = %s", opts_ptr->no_loopback ? "disabled" : "enabled");
+  }
   output(info_lvl, "  transmission period  = %ld", opts_ptr->period);
   output(info_lvl, "  transmission stagger = %ld", opts_ptr->stagger);
   if(opts_ptr->max_pkt_cnt > 0){
@@ -105,6 +202,23 @@ void print_selected_options(const struct options *opts_ptr)
   }else{
     output(info_lvl,"  max packet count     = infinite");
   }
+  output(info_lvl, "  two-step mode        = %s", opts_ptr->two_step ? "enabled" : "disabled");
+  if(opts_ptr->txtime_lead != -1){
+    output(info_lvl, "  scheduled launch     = %ld us ahead", opts_ptr->txtime_lead);
+  }else{
+    output(info_lvl, "  scheduled launch     = disabled");
+  }
+  if(opts_ptr->burst_size > 1){
+    output(info_lvl, "  burst transmission   = %d packets, %ld us spacing", opts_ptr->burst_size,
+	   opts_ptr->burst_spacing);
+  }else{
+    output(info_lvl, "  burst transmission   = disabled");
+  }
+  if(opts_ptr->version == ts_pkt_v2){
+    output(info_lvl, "  packet format        = v2, session %ld", opts_ptr->session_id);
+  }else{
+    output(info_lvl, "  packet format        = v1");
+  }
   if(opts_ptr->tos != -1){
     output(info_lvl,"  UDP packet TOS field = 0x%02x", opts_ptr->tos);
   }else{
@@ -120,4 +234,9 @@ void print_selected_options(const struct options *opts_ptr)
   }else{
     output(info_lvl,"  nonce filename       = not set");
   }
+  if(opts_ptr->key_filename){
+    output(info_lvl,"  nonce lease size     = %ld", opts_ptr->lease_size);
+    output(info_lvl,"  packet MAC           = %s, %zu byte tag",
+	   mac_alg_name(opts_ptr->mac_spec.alg), opts_ptr->mac_spec.tag_len);
+  }
 }
@@ -7,6 +7,7 @@
 #include <sys/types.h>
 
 /* PSP Common headers */
+#include "../common/mac.h"
 #include "../common/options.h"
 
 /* option structure */
@@ -16,13 +17,28 @@ struct options
   struct general_options gen_opts;
 
   /* destination options */
-  struct sockaddr_in slave_addr;
+  struct sockaddr_storage slave_addr;
+  in_port_t slave_port;
+  const char *slave_list_filename;
   int bcast_enabled;
 
+  /* multicast options */
+  int hops;
+  const char *ifname;
+  int no_loopback;
+
   /* timestamp transmission options */
   long period;
   long stagger;
   long max_pkt_cnt;
+  int two_step;
+  long txtime_lead;
+  int burst_size;
+  long burst_spacing;
+
+  /* packet format options */
+  int version;
+  long session_id;
   
   /* QoS options */
   int tos;
@@ -30,6 +46,8 @@ struct options
   /* secure protocol options */
   const char *key_filename;
   const char *nonce_filename;
+  long lease_size;
+  struct mac_spec mac_spec;
 };
 
 /* options parsing functions */
@@ -0,0 +1,109 @@
+/* C standard library headers */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* POSIX library headers */
+#include <arpa/inet.h>
+
+/* PSP Common headers */
+#include "../common/net.h"
+#include "../common/output.h"
+
+/* PSP Master headers */
+#include "slaves.h"
+
+/* functions forward declarations */
+static int parse_slave_line(char *, in_port_t, struct sockaddr_storage *);
+
+/* slave list management functions */
+struct sockaddr_storage *read_slave_list(const char *filename, in_port_t default_port,
+					 long *cnt_ptr)
+{
+  struct sockaddr_storage *addrs = NULL;
+  struct sockaddr_storage *new_addrs;
+  long size = 0;
+  long line_num = 0;
+  char line[256];
+  int res;
+
+  FILE *file_ptr = fopen(filename, "r");
+  if(!file_ptr){
+    output(erro_lvl, "cannot open slave list file '%s' for reading", filename);
+  }
+  *cnt_ptr = 0;
+  while(fgets(line, sizeof(line), file_ptr)){
+    line_num++;
+    if(*cnt_ptr == size){
+      size = size ? size * 2 : 16;
+      new_addrs = realloc(addrs, size * sizeof(*addrs));
+      if(!new_addrs){
+	free(addrs);
+	fclose(file_ptr);
+	output(erro_lvl, "cannot allocate slave list");
+      }
+      addrs = new_addrs;
+    }
+    res = parse_slave_line(line, default_port, &addrs[*cnt_ptr]);
+    if(res == -1){
+      free(addrs);
+      fclose(file_ptr);
+      output(erro_lvl, "invalid slave endpoint at line %ld of slave list file '%s'",
+	     line_num, filename);
+    }else if(res == 1){
+      if(addrs[*cnt_ptr].ss_family != addrs[0].ss_family){
+	free(addrs);
+	fclose(file_ptr);
+	output(erro_lvl, "slave at line %ld of slave list file '%s' mixes IPv4 and IPv6 "
+	       "addresses", line_num, filename);
+      }
+      (*cnt_ptr)++;
+    }
+  }
+  if(ferror(file_ptr)){
+    free(addrs);
+    fclose(file_ptr);
+    output(erro_lvl, "failure reading slave list file '%s'", filename);
+  }
+  if(fclose(file_ptr) == EOF){
+    free(addrs);
+    output(erro_lvl, "failure closing slave list file '%s'", filename);
+  }
+  if(*cnt_ptr == 0){
+    free(addrs);
+    output(erro_lvl, "slave list file '%s' contains no slave", filename);
+  }
+  return addrs;
+}
+
+/* helper functions */
+static int parse_slave_line(char *line, in_port_t default_port,
+			    struct sockaddr_storage *addr_ptr)
+{
+  /* each line holds an address optionally followed by a port,
+     empty lines and lines starting with '#' are skipped */
+  char *addr_str = strtok(line, " \t\r\n");
+  char *port_str;
+  char *end_ptr;
+  long port;
+
+  if(!addr_str || (*addr_str == '#')){
+    return 0;
+  }
+  if(!parse_sockaddr(addr_str, addr_ptr)){
+    return -1;
+  }
+  port_str = strtok(NULL, " \t\r\n");
+  if(port_str && (*port_str != '#')){
+    errno = 0;
+    port = strtol(port_str, &end_ptr, 10);
+    if(errno || (*end_ptr != '\0') || (port < 1) || (port > 65535)){
+      return -1;
+    }
+    set_sockaddr_port(addr_ptr, htons((in_port_t) port));
+  }else{
+    set_sockaddr_port(addr_ptr, default_port);
+  }
+  return 1;
+}
@@ -0,0 +1,11 @@
+#ifndef PSPM_SLAVES_H
+#define PSPM_SLAVES_H
+
+/* POSIX library headers */
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/* slave list management functions */
+struct sockaddr_storage *read_slave_list(const char *, in_port_t, long *);
+
+#endif /* PSPM_SLAVES_H */
@@ -1,46 +1,107 @@
+/* Configuration header */
+#include "../config.h"
+
 /* C standard library headers */
+#include <errno.h>
 #include <memory.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* POSIX library headers */
 #include <arpa/inet.h>
+#include <net/if.h>
 #include <netinet/in.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 
 /* PSP Common headers */
+#include "../common/net.h"
 #include "../common/output.h"
+#include "../common/rt.h"
+#include "../common/sock_ts.h"
 
 /* PSP Master headers */
 #include "nonce.h"
+#include "slaves.h"
 #include "state.h"
 
+/* functions forward declarations */
+static void init_dests(struct master_state *, const struct options *);
+static void init_hops(const struct master_state *, const struct options *);
+
 /* master state management functions */
 void init_state_from_options(struct master_state *state_ptr, const struct options *opt_ptr)
 {
   /* trivial state initializaton */
-  state_ptr->socket_desc = 0;
-  memcpy(&state_ptr->slave_addr, &opt_ptr->slave_addr, sizeof(struct sockaddr_in));
+  state_ptr->socket_desc = -1;
+  state_ptr->dest_cnt = 0;
+  state_ptr->dests = NULL;
+  state_ptr->msgs = NULL;
+  state_ptr->iovs = NULL;
+  state_ptr->ctrl_buffs = NULL;
   state_ptr->period = opt_ptr->period;
   state_ptr->stagger = opt_ptr->stagger;
   state_ptr->pkt_cnt = opt_ptr->max_pkt_cnt;
   state_ptr->pkt_idx = 1;
-  state_ptr->pkt_buff = NULL;
-  state_ptr->nonce_file = NULL;
+  state_ptr->two_step = opt_ptr->two_step;
+  state_ptr->version = opt_ptr->version;
+  state_ptr->session_id = (uint32_t) opt_ptr->session_id;
+  state_ptr->burst_size = opt_ptr->burst_size;
+  state_ptr->burst_spacing = opt_ptr->burst_spacing * 1000;
+  state_ptr->txtime = txtime_disabled;
+  state_ptr->txtime_lead = opt_ptr->txtime_lead * 1000;
+  state_ptr->txtime_checks = 0;
+  /* a scheduled launch delays the transmit timestamp by the lead */
+  state_ptr->tx_ts_timeout = 100;
+  if(opt_ptr->txtime_lead != -1){
+    state_ptr->tx_ts_timeout += (int) ((opt_ptr->txtime_lead + 999) / 1000);
+  }
+  state_ptr->tx_key = 0;
+  reset_basic_stats(&state_ptr->spread_bs);
+  state_ptr->lease.file_desc = -1;
+  state_ptr->sched.timer_desc = -1;
+  state_ptr->sched.signal_desc = -1;
+
+  /* slave destinations initialization */
+  init_dests(state_ptr, opt_ptr);
+
+  /* transmit timestamps are needed by follow-ups and to measure the fan-out spread */
+  state_ptr->tx_ts = state_ptr->two_step || (state_ptr->dest_cnt > 1);
 
   /* socket initialization */
-  state_ptr->socket_desc = socket(AF_INET, SOCK_DGRAM, 0);
+  int family = state_ptr->dests[0].addr.ss_family;
+  int level = (family == AF_INET6) ? IPPROTO_IPV6 : IPPROTO_IP;
+  state_ptr->socket_desc = socket(family, SOCK_DGRAM, 0);
   if(state_ptr->socket_desc == -1){
     output(erro_lvl, "failure creating UDP socket");
   }else if(opt_ptr->bcast_enabled && (setsockopt(state_ptr->socket_desc, SOL_SOCKET,
 						 SO_BROADCAST, &opt_ptr->bcast_enabled,
 						 sizeof(opt_ptr->bcast_enabled)) == -1)){
     output(erro_lvl, "failure enabling broadcast on UDP socket");
-  }else if((opt_ptr->tos != -1) && (setsockopt(state_ptr->socket_desc, IPPROTO_IP,
-					       IP_TOS, &opt_ptr->tos,
-					       sizeof(opt_ptr->tos)) == -1)){
+  }else if((opt_ptr->tos != -1) && (setsockopt(state_ptr->socket_desc, level,
+					       (family == AF_INET6) ? IPV6_TCLASS : IP_TOS,
+					       &opt_ptr->tos, sizeof(opt_ptr->tos)) == -1)){
     output(erro_lvl, "failure setting UDP socket TOS field");
+  }else if(state_ptr->tx_ts && !enable_tx_timestamps(state_ptr->socket_desc)){
+    output(erro_lvl, "failure enabling transmit timestamps on UDP socket");
+  }
+  init_hops(state_ptr, opt_ptr);
+  if(opt_ptr->txtime_lead != -1){
+    if(enable_txtime(state_ptr->socket_desc, CLOCK_TAI)){
+      /* SO_TXTIME is accepted even when the egress queueing discipline
+	 ignores launch times, so the first packets are checked through
+	 their transmit timestamps */
+      state_ptr->txtime = txtime_kernel;
+      state_ptr->txtime_checks = TXTIME_CHECK_PKTS;
+      if(!state_ptr->tx_ts && !enable_tx_timestamps(state_ptr->socket_desc)){
+	output(erro_lvl, "failure enabling transmit timestamps on UDP socket");
+      }
+      state_ptr->tx_ts = 1;
+    }else{
+      output(warn_lvl, "SO_TXTIME not available, falling back to user space launch");
+      state_ptr->txtime = txtime_user;
+    }
   }
 
   /* security functions initialization */
@@ -48,39 +109,40 @@ void init_state_from_options(struct master_state *state_ptr, const struct option
     state_ptr->secure = 1;
 
     /* secure key loading */
+    uint8_t key[32];
     FILE *key_file = fopen(opt_ptr->key_filename, "r");
     if(!key_file){
       output(erro_lvl, "cannot open key file '%s' for reading", opt_ptr->key_filename);
-    }else if(fread(&state_ptr->key, 32, 1, key_file) != 1){
+    }else if(fread(key, 32, 1, key_file) != 1){
 	output(erro_lvl, "failure reading key from key file '%s'", opt_ptr->key_filename);
     }else if(fclose(key_file) == EOF){
       output(erro_lvl, "failure closing key file '%s'", opt_ptr->key_filename);
     }
+    init_mac_context(&state_ptr->mac_ctx, &opt_ptr->mac_spec, key);
+    state_ptr->mac_ptr = &state_ptr->mac_ctx;
+    memset(key, 0, sizeof(key));
 
-    /* nonce file opening */
-    state_ptr->nonce_file = fopen(opt_ptr->nonce_filename, "r+");
-    if(state_ptr->nonce_file){
-      state_ptr->pkt_idx = read_nonce(state_ptr->nonce_file);
-    }else{
-      state_ptr->nonce_file = fopen(opt_ptr->nonce_filename, "w");
-      if(!state_ptr->nonce_file){
-	output(erro_lvl, "cannot open nonce file for writing");
-      }else{
-	write_nonce(state_ptr->nonce_file, state_ptr->pkt_idx);
-      }
-    }
+    /* nonce lease initialization */
+    init_nonce_lease(&state_ptr->lease, opt_ptr->nonce_filename,
+		     (ts_pkt_idx_t) opt_ptr->lease_size, &state_ptr->pkt_idx);
   }else{
     state_ptr->secure = 0;
-    state_ptr->nonce_file = NULL;
+    state_ptr->mac_ptr = NULL;
   }
 
-  /* packet buffer initialization */
-  state_ptr->pkt_size = ts_pkt_size(state_ptr->secure);
-  state_ptr->pkt_buff = malloc(state_ptr->pkt_size);
-  if(!state_ptr->pkt_buff){
-    output(erro_lvl, "cannot allocate buffer for timestamp packets transmission");
+  /* packet buffers initialization, one per destination */
+  state_ptr->pkt_size = ts_pkt_size(state_ptr->mac_ptr, state_ptr->version, state_ptr->two_step ?
+				     ts_pkt_two_step_sync : ts_pkt_sync);
+  for(long i = 0; i < state_ptr->dest_cnt; i++){
+    state_ptr->dests[i].pkt_buff = malloc(state_ptr->pkt_size);
+    if(!state_ptr->dests[i].pkt_buff){
+      output(erro_lvl, "cannot allocate buffer for timestamp packets transmission");
+    }
   }
 
+  /* scheduler initialization */
+  init_scheduler(&state_ptr->sched, state_ptr->period, state_ptr->stagger);
+
   output(debg_lvl, "Master state created");
 }
 
@@ -89,11 +151,112 @@ void fini_state(void *ptr)
   struct master_data *data_ptr = (struct master_data *) ptr;
   struct master_state *state_ptr = (struct master_state *) &data_ptr->state;
 
-  free(state_ptr->pkt_buff);
-  if(state_ptr->nonce_file && (fclose(state_ptr->nonce_file) == EOF)){
-    output(erro_lvl, "failure closing nonce file");
+  fini_scheduler(&state_ptr->sched);
+  if(basic_stats_count(&state_ptr->spread_bs)){
+    output(info_lvl, "fan-out first to last transmission spread:");
+    print_basic_stats(&state_ptr->spread_bs, info_lvl);
+  }
+  if(state_ptr->dests){
+    for(long i = 0; i < state_ptr->dest_cnt; i++){
+      free(state_ptr->dests[i].pkt_buff);
+    }
   }
-  if(close(state_ptr->socket_desc) == -1){
+  free(state_ptr->dests);
+  free(state_ptr->msgs);
+  free(state_ptr->iovs);
+  free(state_ptr->ctrl_buffs);
+  fini_nonce_lease(&state_ptr->lease, state_ptr->pkt_idx);
+  if((state_ptr->socket_desc != -1) && (close(state_ptr->socket_desc) == -1)){
     output(erro_lvl, "failure closing UDP socket");
   }
+  print_ctx_switches();
+}
+
+/* helper functions */
+static void init_dests(struct master_state *state_ptr, const struct options *opt_ptr)
+{
+  struct sockaddr_storage *addrs;
+  long i;
+
+  if(opt_ptr->slave_list_filename){
+    addrs = read_slave_list(opt_ptr->slave_list_filename, opt_ptr->slave_port,
+			    &state_ptr->dest_cnt);
+  }else{
+    state_ptr->dest_cnt = 1;
+    addrs = malloc(sizeof(*addrs));
+    if(!addrs){
+      output(erro_lvl, "cannot allocate slave destinations");
+    }
+    memcpy(addrs, &opt_ptr->slave_addr, sizeof(*addrs));
+    set_sockaddr_port(addrs, opt_ptr->slave_port);
+  }
+  state_ptr->dests = calloc(state_ptr->dest_cnt, sizeof(*state_ptr->dests));
+  state_ptr->msgs = calloc(state_ptr->dest_cnt, sizeof(*state_ptr->msgs));
+  state_ptr->iovs = calloc(state_ptr->dest_cnt, sizeof(*state_ptr->iovs));
+  state_ptr->ctrl_buffs = calloc(state_ptr->dest_cnt, TXTIME_CMSG_SPACE);
+  if(!state_ptr->dests || !state_ptr->msgs || !state_ptr->iovs || !state_ptr->ctrl_buffs){
+    free(addrs);
+    output(erro_lvl, "cannot allocate slave destinations");
+  }
+  for(i = 0; i < state_ptr->dest_cnt; i++){
+    memcpy(&state_ptr->dests[i].addr, &addrs[i], sizeof(addrs[i]));
+    state_ptr->dests[i].addr_len = sockaddr_len(&addrs[i]);
+  }
+  free(addrs);
+  output(debg_lvl, "%ld slave destinations loaded", state_ptr->dest_cnt);
+
+  /* the slave list addresses are only known here, the list shares one family */
+  if(opt_ptr->slave_list_filename){
+    if(opt_ptr->bcast_enabled && (state_ptr->dests[0].addr.ss_family != AF_INET)){
+      output(erro_lvl, "broadcast is not available with IPv6 addresses");
+    }
+    if(opt_ptr->ifname || opt_ptr->no_loopback){
+      for(i = 0; (i < state_ptr->dest_cnt) && !is_multicast_sockaddr(&state_ptr->dests[i].addr); i++);
+      if(i == state_ptr->dest_cnt){
+	output(erro_lvl, "multicast options require a multicast slave address");
+      }
+    }
+  }
+}
+
+static void init_hops(const struct master_state *state_ptr, const struct options *opt_ptr)
+{
+  int ipv6 = state_ptr->dests[0].addr.ss_family == AF_INET6;
+  int level = ipv6 ? IPPROTO_IPV6 : IPPROTO_IP;
+  int multicast = is_multicast_sockaddr(&state_ptr->dests[0].addr);
+  int loop = 0;
+  int ifindex = 0;
+
+  if((opt_ptr->hops != -1) &&
+     (setsockopt(state_ptr->socket_desc, level,
+		 ipv6 ? (multicast ? IPV6_MULTICAST_HOPS : IPV6_UNICAST_HOPS) :
+		 (multicast ? IP_MULTICAST_TTL : IP_TTL),
+		 &opt_ptr->hops, sizeof(opt_ptr->hops)) == -1)){
+    output(erro_lvl, "failure setting UDP socket TTL/hop limit: %s", strerror(errno));
+  }
+  if(opt_ptr->ifname){
+    ifindex = (int) if_nametoindex(opt_ptr->ifname);
+    if(!ifindex){
+      output(erro_lvl, "unknown interface '%s'", opt_ptr->ifname);
+    }else if(ipv6){
+      if(setsockopt(state_ptr->socket_desc, level, IPV6_MULTICAST_IF,
+		    &ifindex, sizeof(ifindex)) == -1){
+	output(erro_lvl, "failure setting multicast interface: %s", strerror(errno));
+      }
+    }else{
+      struct ip_mreqn mreqn;
+      memset(&mreqn, 0, sizeof(mreqn));
+      mreqn.imr_ifindex = ifindex;
+      if(setsockopt(state_ptr->socket_desc, level, IP_MULTICAST_IF,
+		    &mreqn, sizeof(mreqn)) == -1){
+	output(erro_lvl, "failure setting multicast interface: %s", strerror(errno));
+      }
+    }
+  }
+  if(opt_ptr->no_loopback &&
+     (setsockopt(state_ptr->socket_desc, level,
+		 ipv6 ? IPV6_MULTICAST_LOOP : IP_MULTICAST_LOOP,
+		 &loop, sizeof(loop)) == -1)){
+    output(erro_lvl, "failure disabling multicast loopback: %s", strerror(errno));
+  }
 }
@@ -4,32 +4,80 @@
 /* C standard library headers */
 #include <stdint.h>
 #include <stdio.h>
+#include <time.h>
+
+/* POSIX library headers */
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 /* PSP Common headers */
+#include "../common/basic_stats.h"
 #include "../common/timestamp.h"
 
 /* PSP Master headers */
+#include "nonce.h"
 #include "options.h"
+#include "timer.h"
+
+/* scheduled launch modes enumeration */
+enum txtime_mode
+{
+  txtime_disabled = 0,
+  txtime_kernel = 1,
+  txtime_user = 2
+};
+
+/* packets whose transmit timestamps are checked against their launch time */
+#define TXTIME_CHECK_PKTS (8)
+
+/* destination structure */
+struct destination
+{
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+  uint8_t *pkt_buff;
+  int tx_ts_valid;
+  struct timespec tx_ts;
+};
 
 /* master state structure */
 struct master_state
 {
-  /* socket and slave address/port */
+  /* socket and slave destinations */
   int socket_desc;
-  struct sockaddr_in slave_addr;
+  long dest_cnt;
+  struct destination *dests;
+  struct mmsghdr *msgs;
+  struct iovec *iovs;
+  uint8_t *ctrl_buffs;
 
   /* timestamp transmission data */
   long period;
   long stagger;
   long pkt_cnt;
   ts_pkt_idx_t pkt_idx;
+  int two_step;
+  int version;
+  uint32_t session_id;
+  int burst_size;
+  long burst_spacing;
+  int txtime;
+  long txtime_lead;
+  int txtime_checks;
+  int tx_ts_timeout;
   size_t pkt_size;
-  uint8_t *pkt_buff;
+  struct scheduler sched;
+
+  /* transmit timestamps data */
+  int tx_ts;
+  uint32_t tx_key;
+  struct basic_stats spread_bs;
 
   /* secure protocol data */
   int secure;
-  uint8_t key[32];
-  FILE *nonce_file;
+  struct mac_context mac_ctx;
+  const struct mac_context *mac_ptr;
+  struct nonce_lease lease;
 };
 
 /* master data structure */
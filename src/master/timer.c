@@ -1,76 +1,160 @@
+/* C standard library headers */
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
 /* POSIX library headers */
+#include <poll.h>
 #include <signal.h>
-#include <time.h>
+#include <unistd.h>
+
+/* Linux headers */
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 
-/* LSP Common headers */
+/* PSP Common headers */
+#include "../common/mgmt.h"
 #include "../common/output.h"
 
-/* LSP Master headers */
+/* PSP Master headers */
 #include "timer.h"
 
-/* globals */
-timer_t timer_id;
-int timer_prepared = 0;
-timer_callback_t timer_callback;
-void *timer_data_ptr;
+/* constants */
+#define NSEC_PER_SEC 1000000000L
+#define NSEC_PER_MSEC 1000000L
 
 /* functions forward declarations */
-static void signal_handler(int);
+static void next_deadline(struct scheduler *);
+static void wait_deadline(struct scheduler *);
 
-/* set_timer function */
-void set_timer(long delay, timer_callback_t cb, void* td_ptr)
+/* scheduler management functions */
+void init_scheduler(struct scheduler *sched_ptr, long period, long stagger)
 {
-  struct sigevent sigevent_data;
-  struct itimerspec timer_spec;
-
-  timer_callback = cb;
-  timer_data_ptr = td_ptr;
+  sigset_t set;
 
-  if(!timer_prepared){
-    sigevent_data.sigev_notify = SIGEV_SIGNAL;
-    sigevent_data.sigev_signo = SIGUSR1;
+  sched_ptr->period = period;
+  sched_ptr->stagger = stagger;
+  sched_ptr->count = 0;
+  reset_basic_stats(&sched_ptr->wakeup_bs);
 
-    if(timer_create(CLOCK_REALTIME, &sigevent_data, &timer_id) == -1){
-      output(erro_lvl, "failure creating the timer");
-    }else{
-      timer_prepared = 1;
-    }
+  /* termination signals are handled through the event loop */
+  sigemptyset(&set);
+  sigaddset(&set, SIGINT);
+  sigaddset(&set, SIGTERM);
+  if(sigprocmask(SIG_BLOCK, &set, NULL) == -1){
+    output(erro_lvl, "failure blocking termination signals: %s", strerror(errno));
+  }
+  sched_ptr->signal_desc = signalfd(-1, &set, SFD_CLOEXEC);
+  if(sched_ptr->signal_desc == -1){
+    output(erro_lvl, "failure creating signal descriptor: %s", strerror(errno));
   }
+  sched_ptr->timer_desc = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  if(sched_ptr->timer_desc == -1){
+    output(erro_lvl, "failure creating the timer: %s", strerror(errno));
+  }
+}
 
-  if(timer_prepared){
-    if(signal(SIGUSR1,&signal_handler) == SIG_ERR){
-      output(erro_lvl, "failure installing SIGUSR1 signal handler");
-    }else{
-      timer_spec.it_interval.tv_sec = 0;
-      timer_spec.it_interval.tv_nsec = 0;
-      timer_spec.it_value.tv_sec = delay / 1000l;
-      timer_spec.it_value.tv_nsec = (delay % 1000l) * 1000000;
-      if(timer_settime(timer_id, 0, &timer_spec, NULL) == -1){
-	output(erro_lvl, "failure arming the timer");
-      }
-    }
+void fini_scheduler(struct scheduler *sched_ptr)
+{
+  if(basic_stats_count(&sched_ptr->wakeup_bs)){
+    output(info_lvl, "timer wake-up error:");
+    print_basic_stats(&sched_ptr->wakeup_bs, info_lvl);
+  }
+  if((sched_ptr->timer_desc != -1) && (close(sched_ptr->timer_desc) == -1)){
+    output(erro_lvl, "failure closing the timer");
   }
+  if((sched_ptr->signal_desc != -1) && (close(sched_ptr->signal_desc) == -1)){
+    output(erro_lvl, "failure closing signal descriptor");
+  }
+}
 
+void run_scheduler(struct scheduler *sched_ptr, timer_callback_t cb, void *data_ptr)
+{
+  /* the first event is emitted immediately, following ones are scheduled
+     from the start epoch so that callback execution times do not accumulate */
+  if(clock_gettime(CLOCK_MONOTONIC, &sched_ptr->start) == -1){
+    output(erro_lvl, "failure reading monotonic clock: %s", strerror(errno));
+  }
+  (*cb)(data_ptr);
+  while(1){
+    next_deadline(sched_ptr);
+    wait_deadline(sched_ptr);
+    (*cb)(data_ptr);
+  }
 }
 
-void wait_signals()
+/* helper functions */
+static void next_deadline(struct scheduler *sched_ptr)
 {
-  sigset_t set;
-  int signo;
-
-  if(sigfillset(&set) == -1){
-    output(erro_lvl, "sigfillset failure");
-  }else{
-    while(1){
-      sigwait(&set, &signo);
-      raise(signo);
-    }
+  double rnd = ((double) rand()) / ((double) RAND_MAX + 1.0);
+  long ofs_nsec;
+
+  /* offsets within plus or minus half the stagger keep the gap between
+     consecutive packets within the period plus or minus the stagger */
+  sched_ptr->count++;
+  ofs_nsec = (long) (((double) sched_ptr->stagger * rnd -
+		      (double) sched_ptr->stagger / 2.) * (double) NSEC_PER_MSEC);
+  sched_ptr->deadline.tv_sec = sched_ptr->start.tv_sec +
+    (time_t) ((sched_ptr->period * (long) sched_ptr->count) / 1000L);
+  sched_ptr->deadline.tv_nsec = sched_ptr->start.tv_nsec +
+    ((sched_ptr->period * (long) sched_ptr->count) % 1000L) * NSEC_PER_MSEC + ofs_nsec;
+  while(sched_ptr->deadline.tv_nsec >= NSEC_PER_SEC){
+    sched_ptr->deadline.tv_sec++;
+    sched_ptr->deadline.tv_nsec -= NSEC_PER_SEC;
+  }
+  while(sched_ptr->deadline.tv_nsec < 0){
+    sched_ptr->deadline.tv_sec--;
+    sched_ptr->deadline.tv_nsec += NSEC_PER_SEC;
   }
 }
 
-/* signal_handler function */
-static void signal_handler(int signo)
+static void wait_deadline(struct scheduler *sched_ptr)
 {
-  (void) signo;
-  (*timer_callback)(timer_data_ptr);
+  struct itimerspec timer_spec;
+  struct pollfd pfds[2];
+  struct signalfd_siginfo siginfo;
+  struct timespec now;
+  uint64_t expirations;
+  double wakeup_err;
+
+  memset(&timer_spec, 0, sizeof(timer_spec));
+  timer_spec.it_value = sched_ptr->deadline;
+  if(timerfd_settime(sched_ptr->timer_desc, TFD_TIMER_ABSTIME, &timer_spec, NULL) == -1){
+    output(erro_lvl, "failure arming the timer: %s", strerror(errno));
+  }
+
+  pfds[0].fd = sched_ptr->timer_desc;
+  pfds[0].events = POLLIN;
+  pfds[1].fd = sched_ptr->signal_desc;
+  pfds[1].events = POLLIN;
+  while(1){
+    pfds[0].revents = 0;
+    pfds[1].revents = 0;
+    if(poll(pfds, 2, -1) == -1){
+      if(errno != EINTR){
+	output(erro_lvl, "poll failure: %s", strerror(errno));
+      }
+      continue;
+    }
+    if(pfds[1].revents & POLLIN){
+      if(read(sched_ptr->signal_desc, &siginfo, sizeof(siginfo)) == sizeof(siginfo)){
+	output(info_lvl, "received signal %u, exiting...", siginfo.ssi_signo);
+	clean_exit();
+      }
+    }
+    if(pfds[0].revents & POLLIN){
+      if(read(sched_ptr->timer_desc, &expirations, sizeof(expirations)) != sizeof(expirations)){
+	continue;
+      }
+      if(clock_gettime(CLOCK_MONOTONIC, &now) == -1){
+	output(erro_lvl, "failure reading monotonic clock: %s", strerror(errno));
+      }
+      wakeup_err = (double) (now.tv_sec - sched_ptr->deadline.tv_sec) +
+	(double) (now.tv_nsec - sched_ptr->deadline.tv_nsec) * 1e-9;
+      output(debg_lvl, "timer wake-up error: %.9f", wakeup_err);
+      add_basic_stats_sample(&sched_ptr->wakeup_bs, wakeup_err);
+      return;
+    }
+  }
 }
@@ -1,11 +1,31 @@
-#ifndef PSP_COMMON_TIMER_H
-#define PSP_COMMON_TIMER_H
+#ifndef PSPM_TIMER_H
+#define PSPM_TIMER_H
+
+/* C standard library headers */
+#include <time.h>
+
+/* PSP Common headers */
+#include "../common/basic_stats.h"
 
 /* typedefs */
 typedef void (*timer_callback_t)(void *);
 
-/* timer setting function */
-void set_timer(long delay, timer_callback_t cb, void* td_ptr);
-void wait_signals(void);
+/* scheduler data structure */
+struct scheduler
+{
+  int timer_desc;
+  int signal_desc;
+  long period;
+  long stagger;
+  unsigned long count;
+  struct timespec start;
+  struct timespec deadline;
+  struct basic_stats wakeup_bs;
+};
+
+/* scheduler management functions */
+void init_scheduler(struct scheduler *, long, long);
+void fini_scheduler(struct scheduler *);
+void run_scheduler(struct scheduler *, timer_callback_t, void *);
 
-#endif /* PSP_COMMON_TIMER_H */
+#endif /* PSPM_TIMER_H */
@@ -1,20 +1,27 @@
 /* C standard library headers */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 /* PSP Common headers */
-#include "../common/mgmt.h"
 #include "../common/output.h"
 
 /* PSP Slave headers */
 #include "least_squares.h"
 #include "perc_stats.h"
+#include "quant_sketch.h"
+#include "sample_store.h"
 #include "calibr.h"
 #include "ts_handler.h"
 
+/* functions forward declarations */
+static void merge_calibr_sketches(struct slave_state *);
+static void calibr_percs(struct slave_state *, const double *, double *, int);
+
 /* calibration initialization */
 void init_calibr(struct slave_state *state_ptr)
 {
-  FILE *in_file = fopen("precalibr_results.txt", "r");
+  FILE *in_file = open_output_file(state_ptr, "precalibr_results.txt", "r");
   if(!in_file){
       output(warn_lvl, "cannot open pre-calibration output file. Assuming zero frequency offset.");
   }else{
@@ -27,20 +34,31 @@ void init_calibr(struct slave_state *state_ptr)
     fclose(in_file);
   }
 
-  state_ptr->out_file = fopen("calibr_results.txt", "w");
+  if(state_ptr->sketching){
+    merge_calibr_sketches(state_ptr);
+  }
+  if(state_ptr->storing){
+    FILE *store_file = open_output_file(state_ptr, "calibr_samples.bin", "w+");
+    if(!store_file){
+      output(erro_lvl, "cannot open calibration sample file");
+    }
+    init_sample_store(&state_ptr->store, store_file);
+  }
+
+  state_ptr->out_file = open_output_file(state_ptr, "calibr_results.txt", "w");
   if(!state_ptr->out_file){
     output(erro_lvl, "cannot open calibration output file");
   }
   if(state_ptr->debug){
-    state_ptr->debug_timestamp_file = fopen("calibr_timestamp.txt", "w");
+    state_ptr->debug_timestamp_file = open_output_file(state_ptr, "calibr_timestamp.txt", "w");
     if(!state_ptr->debug_timestamp_file){
       output(erro_lvl, "cannot open calibration timestamp file");
     }
-    state_ptr->debug_corr_time_delta_file = fopen("calibr_corr_time_delta.txt", "w");
+    state_ptr->debug_corr_time_delta_file = open_output_file(state_ptr, "calibr_corr_time_delta.txt", "w");
     if(!state_ptr->debug_corr_time_delta_file){
       output(erro_lvl, "cannot open calibration corrected time delta file");
     }
-    state_ptr->debug_time_delta_cdf_file = fopen("calibr_time_delta_cdf.txt", "w");
+    state_ptr->debug_time_delta_cdf_file = open_output_file(state_ptr, "calibr_time_delta_cdf.txt", "w");
     if(!state_ptr->debug_time_delta_cdf_file){
       output(erro_lvl, "cannot open calibration time delta CDF file");
     }
@@ -49,13 +67,43 @@ void init_calibr(struct slave_state *state_ptr)
 
 void fini_calibr(struct slave_state *state_ptr)
 {
-  if(fprintf(state_ptr->out_file, "%.9f\n", perc_stats_perc(&state_ptr->ps, 0.5)) < 0){
+  if(!state_ptr->out_file){
+    return;
+  }
+  const double median_perc = 0.5;
+  double median;
+  calibr_percs(state_ptr, &median_perc, &median, 1);
+  if(fprintf(state_ptr->out_file, "%.9f\n", median) < 0){
     output(erro_lvl, "cannot write calibration results to file");
   }
+  if(state_ptr->sketching){
+    FILE *sketch_file = open_output_file(state_ptr, "calibr_sketch.txt", "w");
+    if(!sketch_file){
+      output(erro_lvl, "cannot open calibration sketch file");
+    }
+    if(!write_quant_sketch(sketch_file, &state_ptr->sketch)){
+      fclose(sketch_file);
+      output(erro_lvl, "cannot write calibration sketch to file");
+    }
+    fclose(sketch_file);
+    output(info_lvl, "%s sketch holds %lu samples in %zu bytes",
+	   sketch_type_name(state_ptr->sketch.type),
+	   quant_sketch_count(&state_ptr->sketch),
+	   quant_sketch_memory(&state_ptr->sketch));
+  }
+  if(state_ptr->storing){
+    output(info_lvl, "calibration sample file holds %ld samples",
+	   sample_store_count(&state_ptr->store));
+  }
   if(state_ptr->debug){
+    double percs[101], values[101];
+    for(int i = 0; i <= 100; i++){
+      percs[i] = i * 0.01;
+    }
+    calibr_percs(state_ptr, percs, values, 101);
     for(int i = 0; i <= 100; i++){
-      double y = i * 0.01;
-      double x = perc_stats_perc(&state_ptr->ps, y);
+      double y = percs[i];
+      double x = values[i];
       if(fprintf(state_ptr->debug_time_delta_cdf_file, "%.9f %.9f\n", x, y) < 0) {
 	output(erro_lvl, "cannot write to time offset CDF file");
       }
@@ -77,9 +125,67 @@ void calibr_handle_ts(struct slave_state *state_ptr, double clk_time, double tim
       output(erro_lvl, "cannot write corrected time delta sample to file");
     }
   }
-  add_perc_stats_sample(&state_ptr->ps, corrected_delta);
-  output(info_lvl, "median time delta: %.9f", perc_stats_perc(&state_ptr->ps, 0.5));
-  if(perc_stats_count(&state_ptr->ps) == perc_stats_max_samples(&state_ptr->ps)){
-    clean_exit();
+  if(state_ptr->storing){
+    /* the exact median is computed only once the calibration ends */
+    add_sample_store_sample(&state_ptr->store, corrected_delta);
+  }else if(state_ptr->sketching){
+    add_quant_sketch_sample(&state_ptr->sketch, corrected_delta);
+    output(info_lvl, "median time delta: %.9f", quant_sketch_perc(&state_ptr->sketch, 0.5));
+  }else{
+    add_perc_stats_sample(&state_ptr->ps, corrected_delta);
+    output(info_lvl, "median time delta: %.9f", perc_stats_perc(&state_ptr->ps, 0.5));
+  }
+  /* merged sketch samples do not count towards this session */
+  if(++state_ptr->calibr_cnt == state_ptr->max_obs_win){
+    state_ptr->finished = 1;
+  }
+}
+
+/* helper functions */
+static void merge_calibr_sketches(struct slave_state *state_ptr)
+{
+  if(!state_ptr->sketch_merge_list){
+    return;
+  }
+  char *list = strdup(state_ptr->sketch_merge_list);
+  if(!list){
+    output(erro_lvl, "cannot allocate sketch file list");
+  }
+  char *save_ptr;
+  for(char *path = strtok_r(list, ",", &save_ptr); path;
+      path = strtok_r(NULL, ",", &save_ptr)){
+    FILE *in_file = fopen(path, "r");
+    if(!in_file){
+      output(erro_lvl, "cannot open calibration sketch file %s", path);
+    }
+    struct quant_sketch other;
+    int ok = read_quant_sketch(in_file, &other);
+    fclose(in_file);
+    if(!ok){
+      output(erro_lvl, "cannot read calibration sketch file %s", path);
+    }
+    if(!merge_quant_sketch(&state_ptr->sketch, &other)){
+      output(erro_lvl, "calibration sketch file %s does not match the sketch type and error", path);
+    }
+    output(info_lvl, "merged %lu samples from calibration sketch file %s",
+	   quant_sketch_count(&other), path);
+    fini_quant_sketch(&other);
+  }
+  free(list);
+}
+
+static void calibr_percs(struct slave_state *state_ptr, const double *percs,
+			 double *values, int cnt)
+{
+  if(state_ptr->storing){
+    sample_store_percs(&state_ptr->store, percs, values, cnt);
+  }else{
+    for(int i = 0; i < cnt; i++){
+      if(state_ptr->sketching){
+	values[i] = quant_sketch_perc(&state_ptr->sketch, percs[i]);
+      }else{
+	values[i] = perc_stats_perc(&state_ptr->ps, percs[i]);
+      }
+    }
   }
 }  
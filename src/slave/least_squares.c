@@ -2,21 +2,50 @@
 #include <float.h>
 #include <math.h>
 #include <memory.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 /* PSP Common headers */
 #include "../common/output.h"
+#include "../common/rt.h"
 
 /* PSP Slave headers */
 #include "least_squares.h"
 
+/* functions forward declarations */
+static void clear_sums(struct least_squares *);
+static void update_sums(struct least_squares *, double, double, double);
+static void recenter_sums(struct least_squares *);
+static void add_comp_sum(struct comp_sum *, double);
+static double sum_value(const struct comp_sum *);
+static long load_points(struct least_squares *);
+static double theil_sen_slope(struct least_squares *);
+static double select_pair_slope(struct least_squares *, long, long);
+#ifdef LEAST_SQUARES_CHECK
+static void check_theil_sen_slope(struct least_squares *, long, double);
+#endif
+static void init_order(struct least_squares *, long);
+static long merge_inversions(struct least_squares *, long, double, int);
+static double repeated_median_slope(struct least_squares *);
+static int point_before(const struct slope_point *, const struct slope_point *, double);
+static int compare_points(const void *, const void *);
+static double select_kth(double *, long, long);
+static double select_median(double *, long);
+static uint64_t slope_key(double);
+static double key_slope(uint64_t);
+
 /* statistics management functions */
 void init_least_squares(struct least_squares *st_ptr, long size)
 {
   st_ptr->size = size;
   st_ptr->xi = malloc((size_t)size * sizeof(double));
   st_ptr->yi = malloc((size_t)size * sizeof(double));
-  if(!st_ptr->xi || !st_ptr->yi){
+  st_ptr->pts = malloc((size_t)size * sizeof(struct slope_point));
+  st_ptr->order = malloc((size_t)size * sizeof(long));
+  st_ptr->tmp = malloc((size_t)size * sizeof(long));
+  st_ptr->slopes = malloc(2 * (size_t)size * sizeof(double));
+  if(!st_ptr->xi || !st_ptr->yi || !st_ptr->pts || !st_ptr->order ||
+     !st_ptr->tmp || !st_ptr->slopes){
     output(erro_lvl, "failure allocating memory for least squares");
   }
   reset_least_squares(st_ptr);
@@ -26,23 +55,53 @@ void fini_least_squares(struct least_squares *st_ptr)
 {
   free(st_ptr->xi);
   free(st_ptr->yi);
+  free(st_ptr->pts);
+  free(st_ptr->order);
+  free(st_ptr->tmp);
+  free(st_ptr->slopes);
+}
+
+void prefault_least_squares(struct least_squares *st_ptr)
+{
+  prefault_buffer(st_ptr->xi, (size_t)st_ptr->size * sizeof(double));
+  prefault_buffer(st_ptr->yi, (size_t)st_ptr->size * sizeof(double));
+  prefault_buffer(st_ptr->pts, (size_t)st_ptr->size * sizeof(struct slope_point));
+  prefault_buffer(st_ptr->order, (size_t)st_ptr->size * sizeof(long));
+  prefault_buffer(st_ptr->tmp, (size_t)st_ptr->size * sizeof(long));
+  prefault_buffer(st_ptr->slopes, 2 * (size_t)st_ptr->size * sizeof(double));
 }
 
 void reset_least_squares(struct least_squares *st_ptr)
 {
   st_ptr->count = 0;
+  st_ptr->first = 0;
+  st_ptr->updates = 0;
+  st_ptr->ref_x = 0.;
+  st_ptr->ref_y = 0.;
+  clear_sums(st_ptr);
 }
 
 void least_squares_add_xy(struct least_squares *st_ptr, double x, double y)
 {
-  if(st_ptr->count < st_ptr->size){
-    st_ptr->count++;
-  }else{
-    memmove(st_ptr->xi, st_ptr->xi + 1, st_ptr->count - 1);
-    memmove(st_ptr->yi, st_ptr->yi + 1, st_ptr->count - 1);
+  if(st_ptr->count == 0){
+    /* center the sums on the first point, x values are often absolute times */
+    st_ptr->ref_x = x;
+    st_ptr->ref_y = y;
+  }
+  if(st_ptr->count == st_ptr->size){
+    /* evict the oldest point */
+    update_sums(st_ptr, st_ptr->xi[st_ptr->first], st_ptr->yi[st_ptr->first], -1.);
+    st_ptr->first = (st_ptr->first + 1) % st_ptr->size;
+    st_ptr->count--;
+  }
+  long last = (st_ptr->first + st_ptr->count) % st_ptr->size;
+  st_ptr->xi[last] = x;
+  st_ptr->yi[last] = y;
+  st_ptr->count++;
+  update_sums(st_ptr, x, y, 1.);
+  if(++st_ptr->updates == st_ptr->size){
+    recenter_sums(st_ptr);
   }
-  st_ptr->xi[st_ptr->count - 1] = x;
-  st_ptr->yi[st_ptr->count - 1] = y;
 }
 
 /* stats */
@@ -56,22 +115,401 @@ double least_squares_dy(const struct least_squares *st_ptr)
   if(st_ptr->count < 2){
     return 0.;
   }else{
-    double mean_x = 0;
-    double mean_y = 0;
-    for(long i = 0; i < st_ptr->count; i++){
-      mean_x += st_ptr->xi[i];
-      mean_y += st_ptr->yi[i];
+    double n = (double)st_ptr->count;
+    double sx = sum_value(&st_ptr->sx);
+    double cxx = sum_value(&st_ptr->sxx) - sx * sx / n;
+    double cxy = sum_value(&st_ptr->sxy) - sx * sum_value(&st_ptr->sy) / n;
+    return cxy / cxx;
+  }
+}
+
+double least_squares_dy_stderr(const struct least_squares *st_ptr)
+{
+  if(st_ptr->count < 3){
+    return NAN;
+  }else{
+    double n = (double)st_ptr->count;
+    double sx = sum_value(&st_ptr->sx);
+    double sy = sum_value(&st_ptr->sy);
+    double cxx = sum_value(&st_ptr->sxx) - sx * sx / n;
+    double cxy = sum_value(&st_ptr->sxy) - sx * sy / n;
+    double cyy = sum_value(&st_ptr->syy) - sy * sy / n;
+    double rss = cyy - cxy * cxy / cxx;
+    if(rss < 0.){
+      rss = 0.;
     }
-    mean_x /= (double)st_ptr->count;
-    mean_y /= (double)st_ptr->count;
-
-    double num = 0;
-    double denum = 0;
-    for(long i = 0; i < st_ptr->count; i++){
-      double dx = st_ptr->xi[i] - mean_x;
-      num += dx * (st_ptr->yi[i] - mean_y);
-      denum += dx * dx;
+    return sqrt(rss / (n - 2.) / cxx);
+  }
+}
+
+double least_squares_slope(struct least_squares *st_ptr, int estimator)
+{
+  switch(estimator)
+  {
+    case slope_theil_sen:
+      return theil_sen_slope(st_ptr);
+    case slope_repeated_median:
+      return repeated_median_slope(st_ptr);
+    default:
+      return least_squares_dy(st_ptr);
+  }
+}
+
+const char *slope_estimator_name(int estimator)
+{
+  switch(estimator)
+  {
+    case slope_theil_sen:
+      return "Theil-Sen";
+    case slope_repeated_median:
+      return "repeated median";
+    default:
+      return "least squares";
+  }
+}
+
+/* helper functions */
+static void clear_sums(struct least_squares *st_ptr)
+{
+  memset(&st_ptr->sx, 0, sizeof(st_ptr->sx));
+  memset(&st_ptr->sy, 0, sizeof(st_ptr->sy));
+  memset(&st_ptr->sxx, 0, sizeof(st_ptr->sxx));
+  memset(&st_ptr->sxy, 0, sizeof(st_ptr->sxy));
+  memset(&st_ptr->syy, 0, sizeof(st_ptr->syy));
+}
+
+static void update_sums(struct least_squares *st_ptr, double x, double y, double sign)
+{
+  double dx = x - st_ptr->ref_x;
+  double dy = y - st_ptr->ref_y;
+  add_comp_sum(&st_ptr->sx, sign * dx);
+  add_comp_sum(&st_ptr->sy, sign * dy);
+  add_comp_sum(&st_ptr->sxx, sign * dx * dx);
+  add_comp_sum(&st_ptr->sxy, sign * dx * dy);
+  add_comp_sum(&st_ptr->syy, sign * dy * dy);
+}
+
+static void recenter_sums(struct least_squares *st_ptr)
+{
+  /* once per buffer length the sums are rebuilt around the oldest point,
+     so that neither the distance from the reference nor the rounding
+     errors of the removals grow without bound */
+  st_ptr->updates = 0;
+  st_ptr->ref_x = st_ptr->xi[st_ptr->first];
+  st_ptr->ref_y = st_ptr->yi[st_ptr->first];
+  clear_sums(st_ptr);
+  for(long i = 0; i < st_ptr->count; i++){
+    long j = (st_ptr->first + i) % st_ptr->size;
+    update_sums(st_ptr, st_ptr->xi[j], st_ptr->yi[j], 1.);
+  }
+}
+
+static void add_comp_sum(struct comp_sum *sum_ptr, double val)
+{
+  /* Neumaier summation */
+  double t = sum_ptr->sum + val;
+  if(fabs(sum_ptr->sum) >= fabs(val)){
+    sum_ptr->comp += (sum_ptr->sum - t) + val;
+  }else{
+    sum_ptr->comp += (val - t) + sum_ptr->sum;
+  }
+  sum_ptr->sum = t;
+}
+
+static double sum_value(const struct comp_sum *sum_ptr)
+{
+  return sum_ptr->sum + sum_ptr->comp;
+}
+
+static long load_points(struct least_squares *st_ptr)
+{
+  /* points are centered like the sums and sorted by x */
+  for(long i = 0; i < st_ptr->count; i++){
+    long j = (st_ptr->first + i) % st_ptr->size;
+    st_ptr->pts[i].x = st_ptr->xi[j] - st_ptr->ref_x;
+    st_ptr->pts[i].y = st_ptr->yi[j] - st_ptr->ref_y;
+  }
+  qsort(st_ptr->pts, (size_t)st_ptr->count, sizeof(struct slope_point), &compare_points);
+  return st_ptr->count;
+}
+
+static double theil_sen_slope(struct least_squares *st_ptr)
+{
+  /* median of the slopes of all the point pairs */
+  long n = load_points(st_ptr);
+  if(n < 2){
+    return 0.;
+  }
+  long pair_cnt = n * (n - 1) / 2;
+  double slope = select_pair_slope(st_ptr, n, (pair_cnt - 1) / 2);
+  if(pair_cnt % 2 == 0){
+    slope = (slope + select_pair_slope(st_ptr, n, pair_cnt / 2)) / 2.;
+  }
+#ifdef LEAST_SQUARES_CHECK
+  check_theil_sen_slope(st_ptr, n, slope);
+#endif
+  return slope;
+}
+
+static double select_pair_slope(struct least_squares *st_ptr, long n, long rank)
+{
+  /* the slope interval (lo, hi] holding the requested rank is bisected on
+     the bits of the slope, counting the pair slopes below a value in
+     O(n log n) as inversions, until it holds at most n slopes which are
+     then enumerated; the extreme slopes are those of adjacent points */
+  long pair_cnt = n * (n - 1) / 2;
+  if(pair_cnt <= 2 * st_ptr->size){
+    /* few enough pairs to enumerate them all */
+    long k = 0;
+    for(long i = 0; i < n; i++){
+      for(long j = i + 1; j < n; j++){
+	st_ptr->slopes[k++] = (st_ptr->pts[j].y - st_ptr->pts[i].y) /
+	  (st_ptr->pts[j].x - st_ptr->pts[i].x);
+      }
     }
-    return num / denum;
+    return select_kth(st_ptr->slopes, pair_cnt, rank);
+  }
+  double lo = INFINITY;
+  double hi = -INFINITY;
+  for(long i = 1; i < n; i++){
+    double slope = (st_ptr->pts[i].y - st_ptr->pts[i - 1].y) /
+      (st_ptr->pts[i].x - st_ptr->pts[i - 1].x);
+    lo = fmin(lo, slope);
+    hi = fmax(hi, slope);
   }
+  lo = nextafter(lo, -INFINITY);
+  /* the counts at the bounds are measured rather than assumed to be none
+     and all of the pairs, with rounded slopes the extreme ones need not be
+     those of adjacent points */
+  init_order(st_ptr, n);
+  long lo_cnt = merge_inversions(st_ptr, n, lo, 0);
+  init_order(st_ptr, n);
+  long hi_cnt = merge_inversions(st_ptr, n, hi, 0);
+  while(hi_cnt - lo_cnt > n){
+    uint64_t lo_key = slope_key(lo);
+    double mid = key_slope(lo_key + (slope_key(hi) - lo_key) / 2);
+    if(mid == lo || mid == hi){
+      /* all the slopes left in the interval are equal to hi */
+      return hi;
+    }
+    init_order(st_ptr, n);
+    long mid_cnt = merge_inversions(st_ptr, n, mid, 0);
+    if(mid_cnt > rank){
+      hi = mid;
+      hi_cnt = mid_cnt;
+    }else{
+      lo = mid;
+      lo_cnt = mid_cnt;
+    }
+  }
+  init_order(st_ptr, n);
+  merge_inversions(st_ptr, n, lo, 0);
+  long slope_cnt = merge_inversions(st_ptr, n, hi, 1);
+  if(slope_cnt > 2 * st_ptr->size){
+    slope_cnt = 2 * st_ptr->size;
+  }
+  if(slope_cnt == 0){
+    return hi;
+  }
+  rank -= lo_cnt;
+  if(rank < 0){
+    rank = 0;
+  }else if(rank >= slope_cnt){
+    rank = slope_cnt - 1;
+  }
+  return select_kth(st_ptr->slopes, slope_cnt, rank);
+}
+
+static long merge_inversions(struct least_squares *st_ptr, long n, double slope, int store)
+{
+  /* sorts the points by y - slope * x with a merge sort starting from the
+     current order and returns the pairs whose order changes, storing their
+     slopes if requested; starting from the x order these are the pairs with
+     a slope not greater than the given one */
+  struct slope_point *pts = st_ptr->pts;
+  long *src = st_ptr->order;
+  long *dst = st_ptr->tmp;
+  long inv_cnt = 0;
+  long max_store = 2 * st_ptr->size;
+  for(long width = 1; width < n; width *= 2){
+    for(long lo = 0; lo < n; lo += 2 * width){
+      long mid = (lo + width < n) ? lo + width : n;
+      long hi = (lo + 2 * width < n) ? lo + 2 * width : n;
+      long i = lo, j = mid, k = lo;
+      while(i < mid && j < hi){
+	if(point_before(&pts[src[j]], &pts[src[i]], slope)){
+	  if(store){
+	    for(long l = i; l < mid && inv_cnt + (l - i) < max_store; l++){
+	      const struct slope_point *a = &pts[src[l]];
+	      const struct slope_point *b = &pts[src[j]];
+	      st_ptr->slopes[inv_cnt + (l - i)] = (b->y - a->y) / (b->x - a->x);
+	    }
+	  }
+	  inv_cnt += mid - i;
+	  dst[k++] = src[j++];
+	}else{
+	  dst[k++] = src[i++];
+	}
+      }
+      while(i < mid){
+	dst[k++] = src[i++];
+      }
+      while(j < hi){
+	dst[k++] = src[j++];
+      }
+    }
+    long *swap = src;
+    src = dst;
+    dst = swap;
+  }
+  if(src != st_ptr->order){
+    memcpy(st_ptr->order, src, (size_t)n * sizeof(long));
+  }
+  return inv_cnt;
+}
+
+#ifdef LEAST_SQUARES_CHECK
+static void check_theil_sen_slope(struct least_squares *st_ptr, long n, double slope)
+{
+  /* brute force cross-check of the selection over all the pair slopes,
+     enabled by building with -DLEAST_SQUARES_CHECK */
+  long pair_cnt = n * (n - 1) / 2;
+  double *slopes = malloc((size_t)pair_cnt * sizeof(double));
+  if(!slopes){
+    output(erro_lvl, "failure allocating memory for Theil-Sen check");
+  }
+  long k = 0;
+  for(long i = 0; i < n; i++){
+    for(long j = i + 1; j < n; j++){
+      slopes[k++] = (st_ptr->pts[j].y - st_ptr->pts[i].y) /
+	(st_ptr->pts[j].x - st_ptr->pts[i].x);
+    }
+  }
+  double ref = select_kth(slopes, pair_cnt, (pair_cnt - 1) / 2);
+  if(pair_cnt % 2 == 0){
+    ref = (ref + select_kth(slopes, pair_cnt, pair_cnt / 2)) / 2.;
+  }
+  free(slopes);
+  if(fabs(slope - ref) > 1e-9 * fabs(ref)){
+    output(warn_lvl, "Theil-Sen slope %.12g differs from brute force %.12g over %ld points",
+	   slope, ref, n);
+  }
+}
+#endif
+
+static void init_order(struct least_squares *st_ptr, long n)
+{
+  for(long i = 0; i < n; i++){
+    st_ptr->order[i] = i;
+  }
+}
+
+static double repeated_median_slope(struct least_squares *st_ptr)
+{
+  /* median over the points of the median slope towards the other points,
+     quadratic in the number of points */
+  long n = load_points(st_ptr);
+  if(n < 2){
+    return 0.;
+  }
+  double *slopes = st_ptr->slopes;
+  double *medians = st_ptr->slopes + st_ptr->size;
+  for(long i = 0; i < n; i++){
+    long m = 0;
+    for(long j = 0; j < n; j++){
+      if(j != i){
+	slopes[m++] = (st_ptr->pts[j].y - st_ptr->pts[i].y) /
+	  (st_ptr->pts[j].x - st_ptr->pts[i].x);
+      }
+    }
+    medians[i] = select_median(slopes, m);
+  }
+  return select_median(medians, n);
+}
+
+static int point_before(const struct slope_point *a, const struct slope_point *b,
+			double slope)
+{
+  /* order by y - slope * x decided on the slope of the pair rather than on
+     rounded differences, so that the pairs counted as not greater than the
+     slope are exactly those whose computed slope is not greater */
+  if(a->x < b->x){
+    return (b->y - a->y) / (b->x - a->x) > slope;
+  }else if(a->x > b->x){
+    return (a->y - b->y) / (a->x - b->x) <= slope;
+  }
+  return a->y < b->y;
+}
+
+static int compare_points(const void *a, const void *b)
+{
+  double xa = ((const struct slope_point *)a)->x;
+  double xb = ((const struct slope_point *)b)->x;
+  return (xa > xb) - (xa < xb);
+}
+
+static double select_kth(double *vals, long cnt, long k)
+{
+  /* quickselect with median of three pivots, reorders vals */
+  long lo = 0;
+  long hi = cnt - 1;
+  while(lo < hi){
+    long mid = lo + (hi - lo) / 2;
+    double a = vals[lo], b = vals[mid], c = vals[hi];
+    double pivot = (a < b) ? ((b < c) ? b : ((a < c) ? c : a)) : ((a < c) ? a : ((b < c) ? c : b));
+    long i = lo, j = hi;
+    while(i <= j){
+      while(vals[i] < pivot){
+	i++;
+      }
+      while(vals[j] > pivot){
+	j--;
+      }
+      if(i <= j){
+	double swap = vals[i];
+	vals[i] = vals[j];
+	vals[j] = swap;
+	i++;
+	j--;
+      }
+    }
+    if(k <= j){
+      hi = j;
+    }else if(k >= i){
+      lo = i;
+    }else{
+      break;
+    }
+  }
+  return vals[k];
+}
+
+static double select_median(double *vals, long cnt)
+{
+  double median = select_kth(vals, cnt, (cnt - 1) / 2);
+  if(cnt % 2 == 0){
+    /* the upper middle value is the smallest above the lower one */
+    double upper = vals[cnt / 2];
+    for(long i = cnt / 2 + 1; i < cnt; i++){
+      upper = fmin(upper, vals[i]);
+    }
+    median = (median + upper) / 2.;
+  }
+  return median;
+}
+
+static uint64_t slope_key(double slope)
+{
+  /* order preserving mapping of doubles to unsigned integers */
+  uint64_t bits;
+  memcpy(&bits, &slope, sizeof(bits));
+  return (bits >> 63) ? ~bits : bits | (UINT64_C(1) << 63);
+}
+
+static double key_slope(uint64_t key)
+{
+  uint64_t bits = (key >> 63) ? key & ~(UINT64_C(1) << 63) : ~key;
+  double slope;
+  memcpy(&slope, &bits, sizeof(slope));
+  return slope;
 }
@@ -1,23 +1,65 @@
 #ifndef PSPS_LEAST_SQUARES_H
 #define PSPS_LEAST_SQUARES_H
 
-/* least squares data structure */
+/* slope estimators enumeration */
+enum slope_estimator
+{
+  slope_least_squares = 0,
+  slope_theil_sen = 1,
+  slope_repeated_median = 2
+};
+
+/* robust estimators point structure */
+struct slope_point
+{
+  double x;
+  double y;
+};
+
+/* compensated sum structure */
+struct comp_sum
+{
+  double sum;
+  double comp;
+};
+
+/* least squares data structure, points are kept in a ring buffer and the
+   regression sums are updated incrementally around a reference point */
 struct least_squares
 {
   long count;
   long size;
+  long first;
+  long updates;
   double *xi;
   double *yi;
+  double ref_x;
+  double ref_y;
+  struct comp_sum sx;
+  struct comp_sum sy;
+  struct comp_sum sxx;
+  struct comp_sum sxy;
+  struct comp_sum syy;
+
+  /* robust estimators scratch buffers */
+  struct slope_point *pts;
+  long *order;
+  long *tmp;
+  double *slopes;
 };
 
 /* statistics management functions */
 void init_least_squares(struct least_squares *, long);
 void fini_least_squares(struct least_squares *);
+void prefault_least_squares(struct least_squares *);
 void reset_least_squares(struct least_squares *);
 void least_squares_add_xy(struct least_squares *, double, double);
 
 /* least squares */
 long least_squares_count(const struct least_squares *);
 double least_squares_dy(const struct least_squares *);
+double least_squares_dy_stderr(const struct least_squares *);
+double least_squares_slope(struct least_squares *, int);
+const char *slope_estimator_name(int);
 
 #endif /* PSPS_STATS_H */
@@ -6,28 +6,57 @@
 #include <string.h>
 #include <time.h>
 
+/* Linux headers */
+#include <sys/epoll.h>
+
 /* PSP Common headers */
 #include "../common/mgmt.h"
 #include "../common/output.h"
+#include "../common/rt.h"
 
 /* PSP Slave headers */
 #include "calibr.h"
 #include "options.h"
 #include "precalibr.h"
+#include "receiver.h"
+#include "sessions.h"
 #include "state.h"
 #include "synch.h"
 #include "ts_handler.h"
 
+/* constants */
+#define MAX_EPOLL_EVENTS 16
+#define MAX_RX_SAMPLES 64
+
 /* functions forward declarations */
 static void mngd_main(void *);
+static void fini_data(void *);
+static ts_handler action_handler(int);
 static void receive_timestamp(struct slave_state *, ts_handler);
+static void receive_sessions(struct session_set *);
+static void handle_packet(struct slave_state *, ts_handler, const struct rx_pkt *);
+static void handle_rx_sample(struct slave_state *, ts_handler, const struct rx_sample *);
+static void handle_sample(struct slave_state *, ts_handler,
+			  const struct timespec *, const struct timespec *,
+			  const struct ts_pkt *);
+static void flush_burst(struct slave_state *, ts_handler);
+static void flush_pending_burst(struct slave_state *);
+static void process_sample(struct slave_state *, ts_handler,
+			   const struct timespec *, const struct timespec *,
+			   const struct ts_pkt *);
+static double sample_time_delta(const struct timespec *, const struct ts_pkt *);
 
 /* main function */
 int main(int argc, char **argv)
 {
   struct slave_data data;
+  struct session_set sessions = {0, 0, NULL, -1};
+  data.sessions = NULL;
   if(parse_command_line(argc, argv, &data.opts)){
-    return run_managed(&mngd_main, &fini_state, &data);
+    if(data.opts.sessions_filename){
+      data.sessions = &sessions;
+    }
+    return run_managed(&mngd_main, &fini_data, &data);
   }else{
     return EXIT_FAILURE;
   }
@@ -41,89 +70,264 @@ static void mngd_main(void *ptr)
   struct slave_state *state_ptr = (struct slave_state *) &data_ptr->state;
   apply_general_options(&opts_ptr->gen_opts);
   print_selected_options(opts_ptr);
-  init_state_from_options(state_ptr, opts_ptr);
-  switch(state_ptr->action)
+  if(data_ptr->sessions){
+    init_sessions_from_file(data_ptr->sessions, opts_ptr->sessions_filename);
+    lock_memory(&opts_ptr->gen_opts);
+    receive_sessions(data_ptr->sessions);
+  }else{
+    init_state_from_options(state_ptr, opts_ptr);
+    lock_memory(&opts_ptr->gen_opts);
+    receive_timestamp(state_ptr, action_handler(state_ptr->action));
+  }
+}
+
+/* managed main finalizer */
+static void fini_data(void *ptr)
+{
+  struct slave_data *data_ptr = (struct slave_data *) ptr;
+  if(data_ptr->sessions){
+    for(long i = 0; i < data_ptr->sessions->count; i++){
+      struct session *sess_ptr = &data_ptr->sessions->sessions[i];
+      if(sess_ptr->active){
+	set_output_tag(sess_ptr->tag);
+	flush_pending_burst(&sess_ptr->state);
+	set_output_tag(NULL);
+      }
+    }
+    fini_sessions(data_ptr->sessions);
+  }else{
+    flush_pending_burst(&data_ptr->state);
+    fini_state(&data_ptr->state);
+  }
+  print_ctx_switches();
+}
+
+static ts_handler action_handler(int action)
+{
+  switch(action)
   {
   case action_precalibr:
-    receive_timestamp(state_ptr, precalibr_handle_ts);
-    break;
+    return precalibr_handle_ts;
   case action_calibr:
-    receive_timestamp(state_ptr, calibr_handle_ts);
-    break;
-  case action_synch:
-    receive_timestamp(state_ptr, synch_handle_ts);
-    break;
+    return calibr_handle_ts;
+  default:
+    return synch_handle_ts;
   }
 }
 
 static void receive_timestamp(struct slave_state *state_ptr,
 			      ts_handler handle_timestamp)
 {
-  struct timespec ts;
-  ts_pkt_idx_t idx;
-  time_t sec;
-  long nsec;
-  ssize_t bytes_read;
-  struct sockaddr_in master_addr;
-  socklen_t addrlen;
+  struct rx_sample samples[MAX_RX_SAMPLES];
+  long count;
   while(1){
-    addrlen = sizeof(master_addr);
-    errno = 0;
-    bytes_read = recvfrom(state_ptr->socket_desc, state_ptr->pkt_buff,
-			  state_ptr->pkt_size + 1, 0,
-			  (struct sockaddr *)&master_addr, &addrlen);
-    if(clock_gettime(CLOCK_REALTIME, &ts) == -1){
-      output(erro_lvl, "failure reading time: %s", strerror(errno));
-    }else if(bytes_read == -1){
-      if(errno != EINTR){
-	output(erro_lvl, "recvfrom failure: %s", strerror(errno));
+    if(state_ptr->rx_threaded){
+      count = pop_rx_samples(&state_ptr->rxt, samples, MAX_RX_SAMPLES);
+      for(long i = 0; (i < count) && !state_ptr->finished; i++){
+	handle_rx_sample(state_ptr, handle_timestamp, &samples[i]);
       }
     }else{
-      output(debg_lvl, "received packet from %s:%hu",
-	     inet_ntoa(master_addr.sin_addr),
-	     ntohs(master_addr.sin_port));
-      if(bytes_read == (ssize_t) state_ptr->pkt_size){
-	if(!read_ts_pkt(state_ptr->pkt_buff, state_ptr->secure, &idx,
-			&sec, &nsec, state_ptr->key)){
-	  output(warn_lvl, "discarded packet due to hmac mismatch");
-	}else if(idx > state_ptr->pkt_idx){
-	  state_ptr->pkt_idx = idx;
-	  output(debg_lvl, "idx %09lu secs: %09lu nsecs: %09lu", idx,
-		 sec, nsec);
-
-	  double clk_time = (double)ts.tv_sec + ((double)ts.tv_nsec) * 1e-9;
-	  double ts_time = (double)sec + ((double)nsec) * 1e-9;
-	  double time_delta = clk_time - ts_time;
-
-	  if(state_ptr->debug_timestamp_file){
-	    if(fprintf(state_ptr->debug_timestamp_file, "%lu %.9f %.9f %.9f\n",
-		       basic_stats_count(&state_ptr->bs),
-		       clk_time,
-		       ts_time,
-		       time_delta) < 0){
-	      output(erro_lvl, "cannot write timestamp information to file");
-	    }
-	  }
-
-	  output(debg_lvl, "time delta: %.9f", time_delta);
-	  add_basic_stats_sample(&state_ptr->bs, time_delta);
-	  print_basic_stats(&state_ptr->bs, debg_lvl);
-
-	  handle_timestamp(state_ptr, clk_time, time_delta);
-
-          if(state_ptr->pkt_cnt >= 0){
-	    state_ptr->pkt_cnt--;
-	  }
-	  if(state_ptr->pkt_cnt == 0){
-	    clean_exit();
-	  }
-	}else{
-	  output(warn_lvl, "discarded packet due to idx %lu <= %lu",
-		 idx, state_ptr->pkt_idx);
-	}
-      }else{
-	output(warn_lvl, "discarded packet due to invalid size");
+      count = receive_packets(&state_ptr->rx);
+      for(long i = 0; (i < count) && !state_ptr->finished; i++){
+	handle_packet(state_ptr, handle_timestamp, &state_ptr->rx.pkts[i]);
+      }
+    }
+    if(state_ptr->finished){
+      clean_exit();
+    }
+  }
+}
+
+static void receive_sessions(struct session_set *set_ptr)
+{
+  struct epoll_event events[MAX_EPOLL_EVENTS];
+  struct session *sess_ptr;
+  int event_cnt;
+  long count;
+  while(set_ptr->active_count){
+    errno = 0;
+    event_cnt = epoll_wait(set_ptr->epoll_desc, events, MAX_EPOLL_EVENTS, -1);
+    if((event_cnt == -1) && (errno != EINTR)){
+      output(erro_lvl, "epoll_wait failure: %s", strerror(errno));
+    }
+    for(int i = 0; i < event_cnt; i++){
+      sess_ptr = (struct session *) events[i].data.ptr;
+      if(!sess_ptr->active){
+	continue;
+      }
+      set_output_tag(sess_ptr->tag);
+      count = receive_packets(&sess_ptr->state.rx);
+      for(long j = 0; (j < count) && !sess_ptr->state.finished; j++){
+	handle_packet(&sess_ptr->state, action_handler(sess_ptr->state.action),
+		      &sess_ptr->state.rx.pkts[j]);
+      }
+      set_output_tag(NULL);
+      if(sess_ptr->state.finished){
+	finish_session(set_ptr, sess_ptr);
       }
     }
   }
+  clean_exit();
+}
+
+static void handle_packet(struct slave_state *state_ptr, ts_handler handle_timestamp,
+			  const struct rx_pkt *pkt_ptr)
+{
+  struct rx_sample sample;
+  if(decode_rx_pkt(pkt_ptr, state_ptr->mac_ptr, &state_ptr->filter, &sample)){
+    handle_rx_sample(state_ptr, handle_timestamp, &sample);
+  }
+}
+
+static void handle_rx_sample(struct slave_state *state_ptr, ts_handler handle_timestamp,
+			     const struct rx_sample *sample_ptr)
+{
+  const struct ts_pkt *pkt_ptr = &sample_ptr->pkt;
+  ts_pkt_idx_t idx = pkt_ptr->idx;
+
+  if((pkt_ptr->version != state_ptr->pkt_version) ||
+     (pkt_ptr->session_id != state_ptr->session_id)){
+    if(pkt_ptr->version == ts_pkt_v2){
+      output(info_lvl, "receiving v2 timestamp packets from master session %lu",
+	     (unsigned long) pkt_ptr->session_id);
+    }else{
+      output(info_lvl, "receiving v1 timestamp packets");
+    }
+    state_ptr->pkt_version = pkt_ptr->version;
+    state_ptr->session_id = pkt_ptr->session_id;
+  }
+
+  if(pkt_ptr->type == ts_pkt_follow_up){
+    if(state_ptr->pending && (idx == state_ptr->pending_pkt.idx)){
+      output(debg_lvl, "follow-up idx %09lu secs: %09lu nsecs: %09lu", idx,
+	     pkt_ptr->sec, pkt_ptr->nsec);
+      state_ptr->pending = 0;
+      handle_sample(state_ptr, handle_timestamp, &state_ptr->pending_rx_ts,
+		    &state_ptr->pending_user_ts, pkt_ptr);
+    }else{
+      output(warn_lvl, "discarded follow-up packet due to unexpected idx %lu", idx);
+    }
+  }else if(idx > state_ptr->pkt_idx){
+    state_ptr->pkt_idx = idx;
+    output(debg_lvl, "idx %09lu secs: %09lu nsecs: %09lu", idx,
+	   pkt_ptr->sec, pkt_ptr->nsec);
+    if(state_ptr->pending){
+      output(warn_lvl, "missing follow-up packet for idx %lu", state_ptr->pending_pkt.idx);
+      state_ptr->pending = 0;
+      handle_sample(state_ptr, handle_timestamp, &state_ptr->pending_rx_ts,
+		    &state_ptr->pending_user_ts, &state_ptr->pending_pkt);
+    }
+    if(pkt_ptr->type == ts_pkt_two_step_sync){
+      state_ptr->pending = 1;
+      state_ptr->pending_pkt = *pkt_ptr;
+      state_ptr->pending_rx_ts = sample_ptr->rx_ts;
+      state_ptr->pending_user_ts = sample_ptr->user_ts;
+    }else{
+      handle_sample(state_ptr, handle_timestamp, &sample_ptr->rx_ts,
+		    &sample_ptr->user_ts, pkt_ptr);
+    }
+  }else{
+    output(warn_lvl, "discarded packet due to idx %lu <= %lu",
+	   idx, state_ptr->pkt_idx);
+  }
+}
+
+static void handle_sample(struct slave_state *state_ptr, ts_handler handle_timestamp,
+			  const struct timespec *rx_ts_ptr,
+			  const struct timespec *user_ts_ptr,
+			  const struct ts_pkt *pkt_ptr)
+{
+  /* only the least delayed packet of each burst is processed */
+  ts_pkt_idx_t burst_idx = pkt_ptr->idx - pkt_ptr->burst_pos;
+  double time_delta;
+
+  if(pkt_ptr->burst_size <= 1){
+    process_sample(state_ptr, handle_timestamp, rx_ts_ptr, user_ts_ptr, pkt_ptr);
+    return;
+  }
+  if(state_ptr->burst_pending && (burst_idx != state_ptr->burst_idx)){
+    flush_burst(state_ptr, handle_timestamp);
+  }
+  time_delta = sample_time_delta(rx_ts_ptr, pkt_ptr);
+  if(!state_ptr->burst_pending || (time_delta < state_ptr->burst_delta)){
+    state_ptr->burst_rx_ts = *rx_ts_ptr;
+    state_ptr->burst_user_ts = *user_ts_ptr;
+    state_ptr->burst_pkt = *pkt_ptr;
+    state_ptr->burst_delta = time_delta;
+  }
+  if(!state_ptr->burst_pending){
+    state_ptr->burst_pending = 1;
+    state_ptr->burst_idx = burst_idx;
+    state_ptr->burst_cnt++;
+  }
+  state_ptr->burst_pkts++;
+  if(pkt_ptr->burst_pos + 1 >= pkt_ptr->burst_size){
+    flush_burst(state_ptr, handle_timestamp);
+  }
+}
+
+static void flush_burst(struct slave_state *state_ptr, ts_handler handle_timestamp)
+{
+  output(debg_lvl, "burst idx %lu: selected packet %u of %u", state_ptr->burst_idx,
+	 state_ptr->burst_pkt.burst_pos + 1, state_ptr->burst_pkt.burst_size);
+  state_ptr->burst_pending = 0;
+  process_sample(state_ptr, handle_timestamp, &state_ptr->burst_rx_ts,
+		 &state_ptr->burst_user_ts, &state_ptr->burst_pkt);
+}
+
+static void flush_pending_burst(struct slave_state *state_ptr)
+{
+  /* the last burst of a run is processed even if its last packet was lost */
+  if(state_ptr->burst_pending && !state_ptr->finished){
+    output(debg_lvl, "flushing incomplete burst idx %lu", state_ptr->burst_idx);
+    flush_burst(state_ptr, action_handler(state_ptr->action));
+  }
+}
+
+static void process_sample(struct slave_state *state_ptr, ts_handler handle_timestamp,
+			   const struct timespec *rx_ts_ptr,
+			   const struct timespec *user_ts_ptr,
+			   const struct ts_pkt *pkt_ptr)
+{
+  double clk_time = (double)rx_ts_ptr->tv_sec + ((double)rx_ts_ptr->tv_nsec) * 1e-9;
+  double user_time = (double)user_ts_ptr->tv_sec + ((double)user_ts_ptr->tv_nsec) * 1e-9;
+  double ts_time = (double)pkt_ptr->sec + ((double)pkt_ptr->nsec) * 1e-9;
+  double time_delta = sample_time_delta(rx_ts_ptr, pkt_ptr);
+
+  if(state_ptr->debug_timestamp_file){
+    if(fprintf(state_ptr->debug_timestamp_file, "%lu %.9f %.9f %.9f %.9f\n",
+	       basic_stats_count(&state_ptr->bs),
+	       clk_time,
+	       ts_time,
+	       time_delta,
+	       user_time) < 0){
+      output(erro_lvl, "cannot write timestamp information to file");
+    }
+  }
+
+  if(state_ptr->rx.kernel_ts){
+    output(debg_lvl, "kernel time: %.9f user time: %.9f latency: %.9f",
+	   clk_time, user_time, user_time - clk_time);
+    add_basic_stats_sample(&state_ptr->rx_lat_bs, user_time - clk_time);
+  }
+
+  output(debg_lvl, "time delta: %.9f", time_delta);
+  add_basic_stats_sample(&state_ptr->bs, time_delta);
+  print_basic_stats(&state_ptr->bs, debg_lvl);
+
+  handle_timestamp(state_ptr, clk_time, time_delta);
+
+  if(state_ptr->pkt_cnt >= 0){
+    state_ptr->pkt_cnt--;
+  }
+  if(state_ptr->pkt_cnt == 0){
+    state_ptr->finished = 1;
+  }
+}
+
+static double sample_time_delta(const struct timespec *rx_ts_ptr, const struct ts_pkt *pkt_ptr)
+{
+  /* the delta is computed from the integer parts first to keep the sub-ns fraction */
+  return (double)(rx_ts_ptr->tv_sec - pkt_ptr->sec) +
+    ((double)(rx_ts_ptr->tv_nsec - pkt_ptr->nsec) - ldexp((double)pkt_ptr->frac, -32)) * 1e-9;
 }
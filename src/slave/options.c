@@ -1,8 +1,10 @@
 /* C standard library headers */
 #include <limits.h>
 #include <stdio.h>
+#include <string.h>
 
 /* PSP Common headers */
+#include "../common/net.h"
 #include "../common/output.h"
 
 /* PSP Slave headers */
@@ -10,6 +12,10 @@
 
 /* functions forward declarations */
 static int custom_option_checks(struct option_descriptor *);
+static int opt_sketch_apply(struct option_descriptor *, const char *, const void *);
+
+/* slave specific options definition macros */
+#define SKETCH_OPT(L, D, T, R, F) {L, 1, D, 0, T, &opt_sketch_apply, NULL, R, F}
 
 /* parse_command_line */
 int parse_command_line(int argc, char **argv, struct options *opts_ptr)
@@ -18,6 +24,7 @@ int parse_command_line(int argc, char **argv, struct options *opts_ptr)
   opts_ptr->slave_port = htons(4242);
   opts_ptr->max_pkt_cnt = -1;
   opts_ptr->obs_win = 120;
+  opts_ptr->slope_estim = slope_least_squares;
   opts_ptr->synch_method = synch_freq;
   opts_ptr->freq_estim_slots = 10;
   opts_ptr->time_step_thr = 10000;
@@ -26,7 +33,26 @@ int parse_command_line(int argc, char **argv, struct options *opts_ptr)
   opts_ptr->time_corr_clamp = LONG_MAX;
   opts_ptr->freq_corr_clamp = LONG_MAX;
   opts_ptr->qs_rounds = 0;
+  opts_ptr->corr_interval = 0;
+  init_sketch_spec(&opts_ptr->sketch_spec);
+  opts_ptr->sketch_merge_list = NULL;
+  opts_ptr->sample_store = 0;
+  opts_ptr->kernel_ts = 0;
+  opts_ptr->rx_batch = 1;
+  opts_ptr->busy_poll = -1;
+  opts_ptr->packet_ring = 0;
+  opts_ptr->ipv6 = 0;
+  memset(&opts_ptr->group, 0, sizeof(opts_ptr->group));
+  memset(&opts_ptr->source, 0, sizeof(opts_ptr->source));
+  opts_ptr->ifname = NULL;
+  opts_ptr->rx_ring_size = 0;
   opts_ptr->key_filename = NULL;
+  init_mac_spec(&opts_ptr->mac_spec);
+  opts_ptr->idx_window = 0;
+  opts_ptr->allowlist_filename = NULL;
+  opts_ptr->rate_limit = 0;
+  opts_ptr->out_dir = NULL;
+  opts_ptr->sessions_filename = NULL;
   opts_ptr->debug = 0;
 
   const int action_precalibr_val = action_precalibr;
@@ -35,11 +61,18 @@ int parse_command_line(int argc, char **argv, struct options *opts_ptr)
   const struct num_bounds win_bounds = {1, 10000000000L};
   const struct num_bounds pkt_cnt_bounds = {1, LONG_MAX};
   const struct num_bounds synch_method_bounds = {0, 2};
+  const struct num_bounds slope_estim_bounds = {0, 2};
   const struct num_bounds freq_estim_slots_bounds = {2,1000};
   const struct num_bounds damp_bounds = {0, 99};
   const struct num_bounds clamp_bounds = {0, LONG_MAX};
   const struct num_bounds time_step_thr_bounds = {1, 3600000000L};
   const struct num_bounds qs_rounds_bounds = {1, 10};
+  const struct num_bounds corr_interval_bounds = {1, 10000000000L};
+  const struct num_bounds rx_batch_bounds = {1, 1024};
+  const struct num_bounds busy_poll_bounds = {0, 1000000};
+  const struct num_bounds rx_ring_size_bounds = {2, 1048576};
+  const struct num_bounds idx_window_bounds = {1, 1000000000};
+  const struct num_bounds rate_limit_bounds = {1, 1000000};
 
   struct option_descriptor optreg[] =
     { /* general options */
@@ -55,6 +88,14 @@ int parse_command_line(int argc, char **argv, struct options *opts_ptr)
      BND_LONG_OPT('n', "<integer>, specifies the number of timestamp packets to receive before stopping",
 		  &opts_ptr->max_pkt_cnt, &pkt_cnt_bounds, "", ""), 
      BND_LONG_OPT('w', "<integer>, specifies the observation window in samples", &opts_ptr->obs_win, &win_bounds, "", ""),
+     BND_INT_OPT('e', "<integer>, specifies the frequency estimator (0=LEAST SQUARES, 1=THEIL-SEN, 2=REPEATED MEDIAN)",
+		 &opts_ptr->slope_estim, &slope_estim_bounds, "", ""),
+
+     /* network options */
+     FLAG_OPT('6', "receives timestamp packets over IPv6 and IPv4", &opts_ptr->ipv6, "", ""),
+     SOCKADDR_OPT('g', "<IP address>, joins the specified IPv4 or IPv6 multicast group", &opts_ptr->group, "", ""),
+     SOCKADDR_OPT('G', "<IP address>, restricts the multicast group to the specified source", &opts_ptr->source, "g", ""),
+     STR_OPT('i', "<interface>, specifies the interface used to join the multicast group", &opts_ptr->ifname, "g", ""),
 
      /* synchronization options */
      BND_INT_OPT('m', "<integer>, specifies the synchronization method (0=STEP, 1=SMOOTH, 2=FREQ)",
@@ -73,9 +114,47 @@ int parse_command_line(int argc, char **argv, struct options *opts_ptr)
                   &opts_ptr->freq_corr_clamp, &clamp_bounds, "s", ""),
      BND_LONG_OPT('q', "<integer>, enables quickstart and specifies the quickstart rounds",
 		  &opts_ptr->qs_rounds, &qs_rounds_bounds, "s", ""),
+     BND_LONG_OPT('I', "<integer>, enables the sliding observation window and specifies the correction interval in samples",
+		  &opts_ptr->corr_interval, &corr_interval_bounds, "s", ""),
+
+     /* calibration options */
+     SKETCH_OPT('Q', "<kll|hdr[:error]>, keeps calibration samples in a KLL sketch with the specified rank error "
+		"or in a log-linear histogram with the specified relative error", &opts_ptr->sketch_spec, "c", ""),
+     STR_OPT('Z', "<filename[,filename...]>, merges the listed calibration sketch files into the calibration",
+	     &opts_ptr->sketch_merge_list, "Q", ""),
+     FLAG_OPT('X', "keeps calibration samples in a memory-mapped file and computes exact percentiles at the end",
+	      &opts_ptr->sample_store, "c", "Q"),
      
+     /* reception options */
+     FLAG_OPT('K', "enables kernel receive timestamps", &opts_ptr->kernel_ts, "", ""),
+     BND_LONG_OPT('b', "<integer>, specifies the maximum number of packets received per system call",
+		  &opts_ptr->rx_batch, &rx_batch_bounds, "", ""),
+     BND_LONG_OPT('y', "<integer>, enables busy-poll reception and specifies the socket busy-poll time in us",
+		  &opts_ptr->busy_poll, &busy_poll_bounds, "", ""),
+     FLAG_OPT('R', "enables reception through a memory-mapped packet ring (requires CAP_NET_RAW)",
+	      &opts_ptr->packet_ring, "", "Kb"),
+     BND_LONG_OPT('j', "<integer>, enables the reception thread and specifies its sample ring size",
+		  &opts_ptr->rx_ring_size, &rx_ring_size_bounds, "", ""),
+
      /* secure protocol options */
      STR_OPT('k', "<filename>, specifies the cryptographic key for timestamp authentication", &opts_ptr->key_filename, "", ""),
+     MAC_OPT('M', "<algorithm[:tag length]>, specifies the packet MAC (hmac-sha256, siphash or blake2s) "
+	     "and its tag length in bytes", &opts_ptr->mac_spec, "k", ""),
+
+     /* filtering options */
+     BND_LONG_OPT('W', "<integer>, specifies the maximum forward jump of the packet index",
+		  &opts_ptr->idx_window, &idx_window_bounds, "", ""),
+     STR_OPT('U', "<filename>, specifies the file of allowed master addresses",
+	     &opts_ptr->allowlist_filename, "", ""),
+     BND_LONG_OPT('r', "<integer>, specifies the maximum packet rate per source in packets per second",
+		  &opts_ptr->rate_limit, &rate_limit_bounds, "", ""),
+
+     /* output options */
+     STR_OPT('o', "<directory>, specifies the directory of result and debug files", &opts_ptr->out_dir, "", ""),
+
+     /* multi-session options */
+     STR_OPT('S', "<filename>, specifies the sessions file and runs one session per line",
+	     &opts_ptr->sessions_filename, "", "acspnwemftTFCDqIQZXKbyRjkMWUrod6gGi"),
 
      /* debugging options */
      FLAG_OPT('d', "enables the generation of debug files", &opts_ptr->debug, "", ""),
@@ -86,9 +165,15 @@ int parse_command_line(int argc, char **argv, struct options *opts_ptr)
 
   struct opt_group optg[] = {GEN_OPTS_GROUP,
                              OPTS_GROUP("action options", "acs"),
-                             OPTS_GROUP("common options", "pnw"),
-                             OPTS_GROUP("synchronization options", "mftTFCDq"),
-                             OPTS_GROUP("secure protocol options", "k"),
+                             OPTS_GROUP("common options", "pnwe"),
+                             OPTS_GROUP("network options", "6gGi"),
+                             OPTS_GROUP("synchronization options", "mftTFCDqI"),
+                             OPTS_GROUP("calibration options", "QZX"),
+                             OPTS_GROUP("reception options", "KbyRj"),
+                             OPTS_GROUP("secure protocol options", "kM"),
+                             OPTS_GROUP("filtering options", "WUr"),
+                             OPTS_GROUP("output options", "o"),
+                             OPTS_GROUP("multi-session options", "S"),
                              OPTS_GROUP("debugging options", "d"),
                              END_OPTS_GROUP};
 
@@ -108,10 +193,54 @@ int parse_command_line(int argc, char **argv, struct options *opts_ptr)
 /* custom opttion checks */
 static int custom_option_checks(struct option_descriptor *optreg)
 {
-  if(!is_opt_set(optreg, 'a') && !is_opt_set(optreg, 'c') && !is_opt_set(optreg, 's')){
+  if(!is_opt_set(optreg, 'a') && !is_opt_set(optreg, 'c') && !is_opt_set(optreg, 's') &&
+     !is_opt_set(optreg, 'S')){
     printf("no action specified\n");
     return 0;
   }
+  if(is_opt_set(optreg, 'g')){
+    const struct sockaddr_storage *group_ptr =
+      (const struct sockaddr_storage *) find_opt_desc(optreg, 'g')->trgt;
+    const struct sockaddr_storage *source_ptr =
+      (const struct sockaddr_storage *) find_opt_desc(optreg, 'G')->trgt;
+    if(!is_multicast_sockaddr(group_ptr)){
+      printf("invalid multicast group address\n");
+      return 0;
+    }
+    if(is_opt_set(optreg, 'G') && (source_ptr->ss_family != group_ptr->ss_family)){
+      printf("multicast source and group shall belong to the same address family\n");
+      return 0;
+    }
+    if(is_opt_set(optreg, '6') && (group_ptr->ss_family != AF_INET6)){
+      printf("IPv4 multicast groups cannot be joined in IPv6 mode\n");
+      return 0;
+    }
+    if(is_opt_set(optreg, 'R') && (group_ptr->ss_family == AF_INET6)){
+      printf("packet ring reception is not available with IPv6\n");
+      return 0;
+    }
+  }
+  if(is_opt_set(optreg, 'I') &&
+     *(const long *) find_opt_desc(optreg, 'I')->trgt > *(const long *) find_opt_desc(optreg, 'w')->trgt){
+    printf("the correction interval shall not exceed the observation window\n");
+    return 0;
+  }
+  if(is_opt_set(optreg, 'R') && is_opt_set(optreg, '6')){
+    printf("packet ring reception is not available with IPv6\n");
+    return 0;
+  }
+  return 1;
+}
+
+/* slave specific options apply callbacks */
+static int opt_sketch_apply(struct option_descriptor *opt_desc_ptr, const char *arg, const void *data_ptr)
+{
+  struct sketch_spec *trgt_spec = (struct sketch_spec *) opt_desc_ptr->trgt;
+  (void) data_ptr;
+  if(!parse_sketch_spec(arg, trgt_spec)){
+    printf("option '-%c': invalid sketch specification \"%s\"\n", opt_desc_ptr->letter, arg);
+    return 0;
+  }
   return 1;
 }
 
@@ -120,10 +249,29 @@ void print_selected_options(const struct options *opts_ptr)
 {
   output(info_lvl, "Packet Synchronization Slave started...");
   output(info_lvl, "Parameters:");
+  if(opts_ptr->sessions_filename){
+    output(info_lvl,"  sessions filename      = %s", opts_ptr->sessions_filename);
+  }else{
+    print_session_options(opts_ptr);
+  }
+}
+
+void print_session_options(const struct options *opts_ptr)
+{
   if(opts_ptr->action == action_precalibr){
     output(info_lvl, "  action                 = pre-calibrate");
   }else if(opts_ptr->action == action_calibr){
     output(info_lvl, "  action                 = calibrate");
+    if(opts_ptr->sketch_spec.type != sketch_exact){
+      output(info_lvl, "  calibration sketch     = %s, %g error",
+	     sketch_type_name(opts_ptr->sketch_spec.type), opts_ptr->sketch_spec.error);
+      output(info_lvl, "  merged sketch files    = %s",
+	     opts_ptr->sketch_merge_list ? opts_ptr->sketch_merge_list : "none");
+    }else if(opts_ptr->sample_store){
+      output(info_lvl, "  calibration sketch     = exact, memory-mapped file");
+    }else{
+      output(info_lvl, "  calibration sketch     = exact");
+    }
   }else{
     output(info_lvl, "  action                 = synchronize");
     if(opts_ptr->synch_method == synch_step){
@@ -152,6 +300,11 @@ void print_selected_options(const struct options *opts_ptr)
     }else{
       output(info_lvl, "  quickstart             = disabled");
     }
+    if(opts_ptr->corr_interval){
+      output(info_lvl, "  correction interval    = %ld", opts_ptr->corr_interval);
+    }else{
+      output(info_lvl, "  correction interval    = observation window");
+    }
   }
   output(info_lvl, "  slave UDP port         = %hu", ntohs(opts_ptr->slave_port));
   if(opts_ptr->max_pkt_cnt > 0){
@@ -160,11 +313,67 @@ void print_selected_options(const struct options *opts_ptr)
     output(info_lvl,"  max packet count       = infinite");
   }
   output(info_lvl, "  observation window     = %ld", opts_ptr->obs_win);
+  output(info_lvl, "  frequency estimator    = %s", slope_estimator_name(opts_ptr->slope_estim));
+  output(info_lvl, "  IPv6 reception         = %s", opts_ptr->ipv6 ? "enabled" : "disabled");
+  if(opts_ptr->group.ss_family != AF_UNSPEC){
+    char addr_str[SOCKADDR_STR_LEN];
+    output(info_lvl, "  multicast group        = %s",
+	   sockaddr_to_str(&opts_ptr->group, addr_str, sizeof(addr_str)));
+    if(opts_ptr->source.ss_family != AF_UNSPEC){
+      output(info_lvl, "  multicast source       = %s",
+	     sockaddr_to_str(&opts_ptr->source, addr_str, sizeof(addr_str)));
+    }else{
+      output(info_lvl, "  multicast source       = any");
+    }
+    output(info_lvl, "  multicast interface    = %s", opts_ptr->ifname ? opts_ptr->ifname : "default");
+  }else{
+    output(info_lvl, "  multicast group        = not set");
+  }
+  if(opts_ptr->packet_ring){
+    output(info_lvl,"  receive timestamps     = packet ring");
+  }else if(opts_ptr->kernel_ts){
+    output(info_lvl,"  receive timestamps     = kernel");
+  }else{
+    output(info_lvl,"  receive timestamps     = user space");
+  }
+  output(info_lvl, "  receive batch size     = %ld", opts_ptr->rx_batch);
+  if(opts_ptr->busy_poll >= 0){
+    output(info_lvl, "  busy-poll reception    = %ld us", opts_ptr->busy_poll);
+  }else{
+    output(info_lvl, "  busy-poll reception    = disabled");
+  }
+  if(opts_ptr->rx_ring_size > 0){
+    output(info_lvl, "  reception thread ring  = %ld samples", opts_ptr->rx_ring_size);
+  }else{
+    output(info_lvl, "  reception thread ring  = disabled");
+  }
   if(opts_ptr->key_filename){
     output(info_lvl,"  key filename           = %s", opts_ptr->key_filename);
+    output(info_lvl,"  packet MAC             = %s, %zu byte tag",
+	   mac_alg_name(opts_ptr->mac_spec.alg), opts_ptr->mac_spec.tag_len);
   }else{
     output(info_lvl,"  key filename           = not set");
   }
+  if(opts_ptr->idx_window > 0){
+    output(info_lvl,"  packet index window    = %ld", opts_ptr->idx_window);
+  }else{
+    output(info_lvl,"  packet index window    = unlimited");
+  }
+  if(opts_ptr->allowlist_filename){
+    output(info_lvl,"  allowlist filename     = %s", opts_ptr->allowlist_filename);
+  }else{
+    output(info_lvl,"  allowlist filename     = not set");
+  }
+  if(opts_ptr->rate_limit > 0){
+    output(info_lvl,"  source rate limit      = %ld pkts/s", opts_ptr->rate_limit);
+  }else{
+    output(info_lvl,"  source rate limit      = disabled");
+  }
+  if(opts_ptr->out_dir){
+    output(info_lvl,"  output directory       = %s", opts_ptr->out_dir);
+  }else{
+    output(info_lvl,"  output directory       = current directory");
+  }
   if(opts_ptr->debug){
     output(info_lvl,"  debug files            = enabled");
   }else{
@@ -4,11 +4,17 @@
 /* POSIX library headers */
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 
 /* PSP Common headers */
+#include "../common/mac.h"
 #include "../common/options.h"
 
+/* PSP Slave headers */
+#include "least_squares.h"
+#include "quant_sketch.h"
+
 /* master action enumeration */
 enum action_type
 {
@@ -38,6 +44,13 @@ struct options
   in_port_t slave_port;
   long max_pkt_cnt;
   long obs_win;
+  int slope_estim;
+
+  /* network options */
+  int ipv6;
+  struct sockaddr_storage group;
+  struct sockaddr_storage source;
+  const char *ifname;
 
   /* synchronization options */
   int synch_method;
@@ -48,9 +61,34 @@ struct options
   long time_corr_clamp;
   long freq_corr_clamp;
   long qs_rounds;
+  long corr_interval;
+
+  /* calibration options */
+  struct sketch_spec sketch_spec;
+  const char *sketch_merge_list;
+  int sample_store;
+
+  /* reception options */
+  int kernel_ts;
+  long rx_batch;
+  long busy_poll;
+  int packet_ring;
+  long rx_ring_size;
 
   /* secure protocol options */
   const char *key_filename;
+  struct mac_spec mac_spec;
+
+  /* filtering options */
+  long idx_window;
+  const char *allowlist_filename;
+  long rate_limit;
+
+  /* output options */
+  const char *out_dir;
+
+  /* multi-session options */
+  const char *sessions_filename;
 
   /* debugging options */
   int debug;
@@ -61,5 +99,6 @@ int parse_command_line(int, char **, struct options *);
 
 /* options reporting */
 void print_selected_options(const struct options *);
+void print_session_options(const struct options *);
 
 #endif /* PSPS_OPTIONS_H */
@@ -6,62 +6,80 @@
 
 /* PSP Common headers */
 #include "../common/output.h"
+#include "../common/rt.h"
 
 /* PSP Slave headers */
 #include "perc_stats.h"
 
+/* empty subtree index */
+#define PERC_NIL (-1)
+
+/* functions forward declarations */
+static int32_t insert_node(struct perc_node *, int32_t, int32_t);
+static int32_t remove_node(struct perc_node *, int32_t, int32_t);
+static void split_tree(struct perc_node *, int32_t, double, int32_t *, int32_t *);
+static int32_t merge_trees(struct perc_node *, int32_t, int32_t);
+static int32_t node_size(const struct perc_node *, int32_t);
+static void update_size(struct perc_node *, int32_t);
+static uint32_t next_prio(struct perc_stats *);
+
 /* percetile statistics management functions */
 void init_perc_stats(struct perc_stats *st_ptr, long max_samples)
 {
+  if(max_samples > INT32_MAX){
+    output(erro_lvl, "too many samples for percentile statistics");
+  }
   st_ptr->max_samples = max_samples;
-  st_ptr->sorted_samples = malloc((size_t)max_samples * sizeof(double));
-  if(!st_ptr->sorted_samples){
+  st_ptr->nodes = malloc((size_t)max_samples * sizeof(struct perc_node));
+  if(!st_ptr->nodes){
     output(erro_lvl, "failure allocating memory for percentile statistics");
   }
+  st_ptr->prio_state = 2463534242U;
   reset_perc_stats(st_ptr);
 }
 
 void fini_perc_stats(struct perc_stats *st_ptr)
 {
-  free(st_ptr->sorted_samples);
+  free(st_ptr->nodes);
+}
+
+void prefault_perc_stats(struct perc_stats *st_ptr)
+{
+  prefault_buffer(st_ptr->nodes, (size_t)st_ptr->max_samples * sizeof(struct perc_node));
 }
 
 void reset_perc_stats(struct perc_stats *st_ptr)
 {
+  /* nodes are handed out again from the start of the arena */
   st_ptr->count = 0;
-  memset(st_ptr->sorted_samples, 0, (size_t)st_ptr->max_samples * sizeof(double));
+  st_ptr->first = 0;
+  st_ptr->root = PERC_NIL;
 }
 
 void add_perc_stats_sample(struct perc_stats *st_ptr, double sample)
 {
-  long begin = 0, end = st_ptr->count;
-  while(begin != end){
-    if(sample > st_ptr->sorted_samples[end - 1]){
-      begin = end;
-    }else{
-      long halfway = begin + (end - begin) / 2;
-      if(sample < st_ptr->sorted_samples[halfway]){
-	if(end == halfway){
-	  end = begin;
-	}else{
-	  end = halfway;
-	}
-      }else{
-	if(begin == halfway){
-	  begin = end;
-	}else{
-	  begin = halfway;
-	}
-      }
-    }
-  }
-  memmove(st_ptr->sorted_samples + begin + 1,
-	  st_ptr->sorted_samples + begin,
-	  (st_ptr->count - begin) * sizeof(double));
-  st_ptr->sorted_samples[begin] = sample;
+  int32_t idx = (int32_t) ((st_ptr->first + st_ptr->count) % st_ptr->max_samples);
+  struct perc_node *node_ptr = &st_ptr->nodes[idx];
+  node_ptr->sample = sample;
+  node_ptr->left = PERC_NIL;
+  node_ptr->right = PERC_NIL;
+  node_ptr->size = 1;
+  node_ptr->prio = next_prio(st_ptr);
+  st_ptr->root = insert_node(st_ptr->nodes, st_ptr->root, idx);
   st_ptr->count++;
 }
 
+void slide_perc_stats_sample(struct perc_stats *st_ptr, double sample, long win)
+{
+  /* evict the oldest samples so that at most win samples are kept */
+  while(st_ptr->count > 0 && st_ptr->count >= win){
+    st_ptr->root = remove_node(st_ptr->nodes, st_ptr->root, (int32_t) st_ptr->first);
+    st_ptr->first = (st_ptr->first + 1) % st_ptr->max_samples;
+    st_ptr->count--;
+  }
+  add_perc_stats_sample(st_ptr, sample);
+}
+
 /* stats */
 long perc_stats_count(const struct perc_stats *st_ptr)
 {
@@ -77,11 +95,22 @@ double perc_stats_perc(const struct perc_stats *st_ptr, double perc)
 {
   if(st_ptr->count == 0){
     return NAN;
-  }else if(st_ptr->count == 1){
-    return st_ptr->sorted_samples[0];
   }else{
-    size_t posi = (size_t)(perc * (double)(st_ptr->count - 1));
-    return st_ptr->sorted_samples[posi];
+    /* descent to the node of rank posi */
+    int32_t posi = (int32_t)(perc * (double)(st_ptr->count - 1));
+    int32_t idx = st_ptr->root;
+    int32_t left_size;
+    while(1){
+      left_size = node_size(st_ptr->nodes, st_ptr->nodes[idx].left);
+      if(posi < left_size){
+	idx = st_ptr->nodes[idx].left;
+      }else if(posi == left_size){
+	return st_ptr->nodes[idx].sample;
+      }else{
+	posi -= left_size + 1;
+	idx = st_ptr->nodes[idx].right;
+      }
+    }
   }
 }
 
@@ -94,3 +123,93 @@ void print_perc_stats(const struct perc_stats *st_ptr, int lvl)
 	 perc_stats_perc(st_ptr, 0.50),
 	 perc_stats_perc(st_ptr, 0.99));
 }
+
+/* helper functions */
+static int32_t insert_node(struct perc_node *nodes, int32_t root, int32_t idx)
+{
+  /* equal samples go to the right, as in a stable insertion */
+  if(root == PERC_NIL){
+    return idx;
+  }else if(nodes[idx].prio > nodes[root].prio){
+    split_tree(nodes, root, nodes[idx].sample, &nodes[idx].left, &nodes[idx].right);
+    update_size(nodes, idx);
+    return idx;
+  }else if(nodes[idx].sample < nodes[root].sample){
+    nodes[root].left = insert_node(nodes, nodes[root].left, idx);
+  }else{
+    nodes[root].right = insert_node(nodes, nodes[root].right, idx);
+  }
+  nodes[root].size++;
+  return root;
+}
+
+static int32_t remove_node(struct perc_node *nodes, int32_t root, int32_t idx)
+{
+  /* samples equal to the root are always in its right subtree */
+  if(root == idx){
+    return merge_trees(nodes, nodes[idx].left, nodes[idx].right);
+  }else if(nodes[idx].sample < nodes[root].sample){
+    nodes[root].left = remove_node(nodes, nodes[root].left, idx);
+  }else{
+    nodes[root].right = remove_node(nodes, nodes[root].right, idx);
+  }
+  nodes[root].size--;
+  return root;
+}
+
+static void split_tree(struct perc_node *nodes, int32_t root, double sample,
+		       int32_t *left_ptr, int32_t *right_ptr)
+{
+  /* left gets the samples strictly smaller than sample */
+  if(root == PERC_NIL){
+    *left_ptr = PERC_NIL;
+    *right_ptr = PERC_NIL;
+  }else if(nodes[root].sample < sample){
+    split_tree(nodes, nodes[root].right, sample, &nodes[root].right, right_ptr);
+    update_size(nodes, root);
+    *left_ptr = root;
+  }else{
+    split_tree(nodes, nodes[root].left, sample, left_ptr, &nodes[root].left);
+    update_size(nodes, root);
+    *right_ptr = root;
+  }
+}
+
+static int32_t merge_trees(struct perc_node *nodes, int32_t left, int32_t right)
+{
+  /* all the samples in left precede the samples in right */
+  if(left == PERC_NIL){
+    return right;
+  }else if(right == PERC_NIL){
+    return left;
+  }else if(nodes[left].prio > nodes[right].prio){
+    nodes[left].right = merge_trees(nodes, nodes[left].right, right);
+    update_size(nodes, left);
+    return left;
+  }else{
+    nodes[right].left = merge_trees(nodes, left, nodes[right].left);
+    update_size(nodes, right);
+    return right;
+  }
+}
+
+static int32_t node_size(const struct perc_node *nodes, int32_t idx)
+{
+  return (idx == PERC_NIL) ? 0 : nodes[idx].size;
+}
+
+static void update_size(struct perc_node *nodes, int32_t idx)
+{
+  nodes[idx].size = 1 + node_size(nodes, nodes[idx].left) + node_size(nodes, nodes[idx].right);
+}
+
+static uint32_t next_prio(struct perc_stats *st_ptr)
+{
+  /* xorshift32, the treap only needs priorities independent of the samples */
+  uint32_t x = st_ptr->prio_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  st_ptr->prio_state = x;
+  return x;
+}
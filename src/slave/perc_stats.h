@@ -1,19 +1,39 @@
 #ifndef PSPS_PERC_STATS_H
 #define PSPS_PERC_STATS_H
 
-/* percentile statistics data structure */
+/* C standard library headers */
+#include <stdint.h>
+
+/* percentile statistics tree node structure */
+struct perc_node
+{
+  double sample;
+  int32_t left;
+  int32_t right;
+  int32_t size;
+  uint32_t prio;
+};
+
+/* percentile statistics data structure, samples are kept in an
+   order-statistic treap whose nodes are allocated from a fixed arena
+   used as a ring, so that the oldest sample can be evicted */
 struct perc_stats
 {
   long count;
   long max_samples;
-  double *sorted_samples;
+  long first;
+  int32_t root;
+  uint32_t prio_state;
+  struct perc_node *nodes;
 };
 
 /* percentile statistics management functions */
 void init_perc_stats(struct perc_stats *, long);
 void fini_perc_stats(struct perc_stats *);
+void prefault_perc_stats(struct perc_stats *);
 void reset_perc_stats(struct perc_stats *);
 void add_perc_stats_sample(struct perc_stats *, double);
+void slide_perc_stats_sample(struct perc_stats *, double, long);
 
 /* stats */
 long perc_stats_count(const struct perc_stats *);
@@ -2,10 +2,10 @@
 #include <stdio.h>
 
 /* PSP Common headers */
+#include "../common/basic_stats.h"
 #include "../common/output.h"
 
 /* PSP Slave headers */
-#include "basic_stats.h"
 #include "least_squares.h"
 #include "perc_stats.h"
 #include "precalibr.h"
@@ -14,16 +14,16 @@
 /* precalibration initialization */
 void init_precalibr(struct slave_state *state_ptr)
 {
-  state_ptr->out_file = fopen("precalibr_results.txt", "w");
+  state_ptr->out_file = open_output_file(state_ptr, "precalibr_results.txt", "w");
   if(!state_ptr->out_file){
     output(erro_lvl, "cannot open pre-calibration output file");
   }
   if(state_ptr->debug){
-    state_ptr->debug_timestamp_file = fopen("precalibr_timestamp.txt", "w");
+    state_ptr->debug_timestamp_file = open_output_file(state_ptr, "precalibr_timestamp.txt", "w");
     if(!state_ptr->debug_timestamp_file){
       output(erro_lvl, "cannot open pre-calibration timestamp file");
     }
-    state_ptr->debug_freq_delta_file = fopen("precalibr_freq_delta.txt", "w");
+    state_ptr->debug_freq_delta_file = open_output_file(state_ptr, "precalibr_freq_delta.txt", "w");
     if(!state_ptr->debug_freq_delta_file){
       output(erro_lvl, "cannot open pre-calibration frequecy delta file");
     }
@@ -32,7 +32,8 @@ void init_precalibr(struct slave_state *state_ptr)
 
 void fini_precalibr(struct slave_state *state_ptr)
 {
-  if(fprintf(state_ptr->out_file, "%.9f\n", least_squares_dy(&state_ptr->ls)) < 0){
+  if(state_ptr->out_file &&
+     (fprintf(state_ptr->out_file, "%.9f\n", least_squares_slope(&state_ptr->ls, state_ptr->slope_estim)) < 0)){
     output(erro_lvl, "cannot write pre-calibration results to file");
   }
 }
@@ -58,8 +59,11 @@ void precalibr_handle_ts(struct slave_state *state_ptr, double clk_time, double
     least_squares_add_xy(&state_ptr->ls, avg_x, median_y);
 
     if(least_squares_count(&state_ptr->ls) > 1) {
-      double freq_off = least_squares_dy(&state_ptr->ls);
+      double freq_off = least_squares_slope(&state_ptr->ls, state_ptr->slope_estim);
       output(info_lvl, "frequency delta: %.9f", freq_off);
+      if(state_ptr->slope_estim == slope_least_squares && least_squares_count(&state_ptr->ls) > 2){
+        output(info_lvl, "frequency delta standard error: %.9f", least_squares_dy_stderr(&state_ptr->ls));
+      }
       if(state_ptr->debug){
 	if(fprintf(state_ptr->debug_freq_delta_file, "%lu %.9f\n", basic_stats_count(&state_ptr->bs), freq_off) < 0){
 	  output(erro_lvl, "cannot write frequecy delta sample to file");
@@ -0,0 +1,468 @@
+/* C standard library headers */
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* PSP Common headers */
+#include "../common/output.h"
+
+/* PSP Slave headers */
+#include "quant_sketch.h"
+
+/* sketch parameters */
+#define KLL_DEFAULT_ERROR (0.001)
+#define KLL_MIN_ERROR (1e-5)
+#define KLL_MAX_K (200000)
+#define HDR_DEFAULT_ERROR (0.001)
+#define HDR_MIN_ERROR (1e-4)
+#define HDR_MAX_SUB_BITS (14)
+#define HDR_UNIT (1e-9)
+#define HDR_MAX_UNITS (UINT64_C(1) << 62)
+
+/* functions forward declarations */
+static void init_kll(struct quant_sketch *, long);
+static void init_hdr(struct quant_sketch *, int);
+static long kll_capacity(const struct quant_sketch *, int);
+static void kll_append(struct quant_sketch *, int, double);
+static void kll_compress(struct quant_sketch *);
+static void kll_compact(struct quant_sketch *, int);
+static void kll_sort(struct quant_sketch *);
+static int cmp_double(const void *, const void *);
+static int cmp_kll_item(const void *, const void *);
+static long hdr_index(const struct quant_sketch *, uint64_t);
+static double hdr_value(const struct quant_sketch *, long);
+
+/* quantile sketch specification functions */
+void init_sketch_spec(struct sketch_spec *spec_ptr)
+{
+  spec_ptr->type = sketch_exact;
+  spec_ptr->error = 0.;
+}
+
+int parse_sketch_spec(const char *str, struct sketch_spec *spec_ptr)
+{
+  /* format: <kll|hdr>[:<error>] */
+  const char *sep = strchr(str, ':');
+  size_t name_len = sep ? (size_t)(sep - str) : strlen(str);
+  double min_error;
+  char *end_ptr;
+
+  if((name_len == 3) && !strncmp(str, "kll", name_len)){
+    spec_ptr->type = sketch_kll;
+    spec_ptr->error = KLL_DEFAULT_ERROR;
+    min_error = KLL_MIN_ERROR;
+  }else if((name_len == 3) && !strncmp(str, "hdr", name_len)){
+    spec_ptr->type = sketch_hdr;
+    spec_ptr->error = HDR_DEFAULT_ERROR;
+    min_error = HDR_MIN_ERROR;
+  }else{
+    return 0;
+  }
+  if(sep){
+    spec_ptr->error = strtod(sep + 1, &end_ptr);
+    if((*(sep + 1) == '\0') || (*end_ptr != '\0') ||
+       !(spec_ptr->error >= min_error) || !(spec_ptr->error <= 0.1)){
+      return 0;
+    }
+  }
+  return 1;
+}
+
+const char *sketch_type_name(int type)
+{
+  switch(type){
+  case sketch_kll:
+    return "kll";
+  case sketch_hdr:
+    return "hdr";
+  default:
+    return "exact";
+  }
+}
+
+/* quantile sketch management functions */
+void init_quant_sketch(struct quant_sketch *sk_ptr, const struct sketch_spec *spec_ptr)
+{
+  if(spec_ptr->type == sketch_kll){
+    /* the KLL rank error is about 2/k */
+    init_kll(sk_ptr, (long) ceil(2.0 / spec_ptr->error));
+  }else{
+    /* bucket half-width relative to the bucket value is at most 2^-sub_bits */
+    init_hdr(sk_ptr, (int) ceil(-log2(spec_ptr->error)));
+  }
+}
+
+void fini_quant_sketch(struct quant_sketch *sk_ptr)
+{
+  if(sk_ptr->levels){
+    for(int h = 0; h < sk_ptr->level_cnt; h++){
+      free(sk_ptr->levels[h].items);
+    }
+  }
+  free(sk_ptr->levels);
+  free(sk_ptr->sorted);
+  free(sk_ptr->pos_buckets);
+  free(sk_ptr->neg_buckets);
+  sk_ptr->levels = NULL;
+  sk_ptr->sorted = NULL;
+  sk_ptr->pos_buckets = NULL;
+  sk_ptr->neg_buckets = NULL;
+}
+
+void add_quant_sketch_sample(struct quant_sketch *sk_ptr, double sample)
+{
+  uint64_t units;
+  sk_ptr->count++;
+  if(sk_ptr->type == sketch_kll){
+    kll_append(sk_ptr, 0, sample);
+    kll_compress(sk_ptr);
+    sk_ptr->sorted_valid = 0;
+  }else{
+    units = (fabs(sample) / HDR_UNIT >= (double) HDR_MAX_UNITS) ?
+      HDR_MAX_UNITS - 1 : (uint64_t) llround(fabs(sample) / HDR_UNIT);
+    if((sample < 0) && units){
+      sk_ptr->neg_buckets[hdr_index(sk_ptr, units)]++;
+    }else{
+      sk_ptr->pos_buckets[hdr_index(sk_ptr, units)]++;
+    }
+  }
+}
+
+int merge_quant_sketch(struct quant_sketch *dst_ptr, const struct quant_sketch *src_ptr)
+{
+  /* KLL sketches with different k can be merged, histograms need the same geometry */
+  if(dst_ptr->type != src_ptr->type){
+    return 0;
+  }else if(dst_ptr->type == sketch_kll){
+    for(int h = 0; h < src_ptr->level_cnt; h++){
+      for(long i = 0; i < src_ptr->levels[h].size; i++){
+	kll_append(dst_ptr, h, src_ptr->levels[h].items[i]);
+      }
+    }
+    dst_ptr->count += src_ptr->count;
+    kll_compress(dst_ptr);
+    dst_ptr->sorted_valid = 0;
+  }else if(dst_ptr->sub_bits != src_ptr->sub_bits){
+    return 0;
+  }else{
+    for(long i = 0; i < dst_ptr->bucket_cnt; i++){
+      dst_ptr->pos_buckets[i] += src_ptr->pos_buckets[i];
+      dst_ptr->neg_buckets[i] += src_ptr->neg_buckets[i];
+    }
+    dst_ptr->count += src_ptr->count;
+  }
+  return 1;
+}
+
+/* sketch files */
+int write_quant_sketch(FILE *file_ptr, const struct quant_sketch *sk_ptr)
+{
+  if(sk_ptr->type == sketch_kll){
+    if(fprintf(file_ptr, "kll %ld %lu %d\n", sk_ptr->k, sk_ptr->count, sk_ptr->level_cnt) < 0){
+      return 0;
+    }
+    for(int h = 0; h < sk_ptr->level_cnt; h++){
+      if(fprintf(file_ptr, "level %d %ld\n", h, sk_ptr->levels[h].size) < 0){
+	return 0;
+      }
+      for(long i = 0; i < sk_ptr->levels[h].size; i++){
+	if(fprintf(file_ptr, "%.17g\n", sk_ptr->levels[h].items[i]) < 0){
+	  return 0;
+	}
+      }
+    }
+  }else{
+    if(fprintf(file_ptr, "hdr %d %lu\n", sk_ptr->sub_bits, sk_ptr->count) < 0){
+      return 0;
+    }
+    for(long i = 0; i < sk_ptr->bucket_cnt; i++){
+      if(sk_ptr->neg_buckets[i] &&
+	 (fprintf(file_ptr, "n %ld %" PRIu64 "\n", i, sk_ptr->neg_buckets[i]) < 0)){
+	return 0;
+      }
+      if(sk_ptr->pos_buckets[i] &&
+	 (fprintf(file_ptr, "p %ld %" PRIu64 "\n", i, sk_ptr->pos_buckets[i]) < 0)){
+	return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+int read_quant_sketch(FILE *file_ptr, struct quant_sketch *sk_ptr)
+{
+  /* the sketch is initialized from the file header */
+  char type[8];
+  long param, size;
+  unsigned long count;
+  int level_cnt, h;
+  double value;
+  char sign;
+  long idx;
+  uint64_t bucket;
+
+  if(fscanf(file_ptr, "%7s %ld %lu", type, &param, &count) != 3){
+    return 0;
+  }
+  if(!strcmp(type, "kll") && (param >= 2) && (param <= KLL_MAX_K)){
+    init_kll(sk_ptr, param);
+    if(fscanf(file_ptr, "%d", &level_cnt) != 1){
+      return 0;
+    }
+    for(int l = 0; l < level_cnt; l++){
+      if((fscanf(file_ptr, " level %d %ld", &h, &size) != 2) || (h < 0) || (h >= 63) || (size < 0)){
+	return 0;
+      }
+      for(long i = 0; i < size; i++){
+	if(fscanf(file_ptr, "%lf", &value) != 1){
+	  return 0;
+	}
+	kll_append(sk_ptr, h, value);
+      }
+    }
+    sk_ptr->count = count;
+    kll_compress(sk_ptr);
+  }else if(!strcmp(type, "hdr") && (param >= 1) && (param <= HDR_MAX_SUB_BITS)){
+    init_hdr(sk_ptr, (int) param);
+    while(fscanf(file_ptr, " %c %ld %" SCNu64, &sign, &idx, &bucket) == 3){
+      if((idx < 0) || (idx >= sk_ptr->bucket_cnt) || ((sign != 'n') && (sign != 'p'))){
+	return 0;
+      }
+      if(sign == 'n'){
+	sk_ptr->neg_buckets[idx] += bucket;
+      }else{
+	sk_ptr->pos_buckets[idx] += bucket;
+      }
+    }
+    sk_ptr->count = count;
+  }else{
+    return 0;
+  }
+  return 1;
+}
+
+/* stats */
+unsigned long quant_sketch_count(const struct quant_sketch *sk_ptr)
+{
+  return sk_ptr->count;
+}
+
+size_t quant_sketch_memory(const struct quant_sketch *sk_ptr)
+{
+  size_t size = 0;
+  if(sk_ptr->type == sketch_kll){
+    for(int h = 0; h < sk_ptr->level_cnt; h++){
+      size += (size_t) sk_ptr->levels[h].alloc * sizeof(double);
+    }
+    size += (size_t) sk_ptr->sorted_size * sizeof(struct kll_item);
+  }else{
+    size = 2 * (size_t) sk_ptr->bucket_cnt * sizeof(uint64_t);
+  }
+  return size;
+}
+
+double quant_sketch_perc(struct quant_sketch *sk_ptr, double perc)
+{
+  /* same rank convention as the exact percentile statistics */
+  uint64_t rank, cumul = 0;
+  if(sk_ptr->count == 0){
+    return NAN;
+  }
+  rank = (uint64_t)(perc * (double)(sk_ptr->count - 1));
+  if(sk_ptr->type == sketch_kll){
+    kll_sort(sk_ptr);
+    for(long i = 0; i < sk_ptr->sorted_size; i++){
+      cumul += sk_ptr->sorted[i].weight;
+      if(cumul > rank){
+	return sk_ptr->sorted[i].value;
+      }
+    }
+    return sk_ptr->sorted[sk_ptr->sorted_size - 1].value;
+  }else{
+    for(long i = sk_ptr->bucket_cnt - 1; i >= 0; i--){
+      cumul += sk_ptr->neg_buckets[i];
+      if(cumul > rank){
+	return -hdr_value(sk_ptr, i);
+      }
+    }
+    for(long i = 0; i < sk_ptr->bucket_cnt; i++){
+      cumul += sk_ptr->pos_buckets[i];
+      if(cumul > rank){
+	return hdr_value(sk_ptr, i);
+      }
+    }
+    return NAN;
+  }
+}
+
+/* helper functions */
+static void init_kll(struct quant_sketch *sk_ptr, long k)
+{
+  memset(sk_ptr, 0, sizeof(*sk_ptr));
+  sk_ptr->type = sketch_kll;
+  sk_ptr->k = (k < 8) ? 8 : k;
+  sk_ptr->error = 2.0 / (double) sk_ptr->k;
+  sk_ptr->rng_state = 2463534242U;
+  sk_ptr->level_cnt = 1;
+  sk_ptr->levels = calloc(1, sizeof(struct kll_level));
+  if(!sk_ptr->levels){
+    output(erro_lvl, "failure allocating memory for quantile sketch");
+  }
+}
+
+static void init_hdr(struct quant_sketch *sk_ptr, int sub_bits)
+{
+  /* values below 2^sub_bits units are exact, each further power of two is
+     split in 2^(sub_bits-1) linear buckets */
+  memset(sk_ptr, 0, sizeof(*sk_ptr));
+  sk_ptr->type = sketch_hdr;
+  sk_ptr->sub_bits = (sub_bits < 1) ? 1 : sub_bits;
+  sk_ptr->error = ldexp(1.0, -sk_ptr->sub_bits);
+  sk_ptr->bucket_cnt = (1L << sk_ptr->sub_bits) + (63L - sk_ptr->sub_bits) * (1L << (sk_ptr->sub_bits - 1));
+  sk_ptr->pos_buckets = calloc((size_t) sk_ptr->bucket_cnt, sizeof(uint64_t));
+  sk_ptr->neg_buckets = calloc((size_t) sk_ptr->bucket_cnt, sizeof(uint64_t));
+  if(!sk_ptr->pos_buckets || !sk_ptr->neg_buckets){
+    output(erro_lvl, "failure allocating memory for quantile sketch");
+  }
+}
+
+static long kll_capacity(const struct quant_sketch *sk_ptr, int h)
+{
+  /* capacities shrink geometrically by 2/3 from the top level down */
+  long cap = (long) ceil((double) sk_ptr->k * pow(2.0 / 3.0, sk_ptr->level_cnt - 1 - h));
+  return (cap < 2) ? 2 : cap;
+}
+
+static void kll_append(struct quant_sketch *sk_ptr, int h, double value)
+{
+  struct kll_level *new_levels;
+  struct kll_level *lvl_ptr;
+  double *new_items;
+  if(h >= sk_ptr->level_cnt){
+    new_levels = realloc(sk_ptr->levels, (size_t)(h + 1) * sizeof(struct kll_level));
+    if(!new_levels){
+      output(erro_lvl, "failure allocating memory for quantile sketch");
+    }
+    memset(new_levels + sk_ptr->level_cnt, 0, (size_t)(h + 1 - sk_ptr->level_cnt) * sizeof(struct kll_level));
+    sk_ptr->levels = new_levels;
+    sk_ptr->level_cnt = h + 1;
+  }
+  lvl_ptr = &sk_ptr->levels[h];
+  if(lvl_ptr->size == lvl_ptr->alloc){
+    lvl_ptr->alloc = lvl_ptr->alloc ? 2 * lvl_ptr->alloc : 16;
+    new_items = realloc(lvl_ptr->items, (size_t) lvl_ptr->alloc * sizeof(double));
+    if(!new_items){
+      output(erro_lvl, "failure allocating memory for quantile sketch");
+    }
+    lvl_ptr->items = new_items;
+  }
+  lvl_ptr->items[lvl_ptr->size++] = value;
+}
+
+static void kll_compress(struct quant_sketch *sk_ptr)
+{
+  long total_size, total_cap;
+  int h;
+  while(1){
+    total_size = 0;
+    total_cap = 0;
+    for(h = 0; h < sk_ptr->level_cnt; h++){
+      total_size += sk_ptr->levels[h].size;
+      total_cap += kll_capacity(sk_ptr, h);
+    }
+    if(total_size <= total_cap){
+      return;
+    }
+    for(h = 0; (h < sk_ptr->level_cnt) && (sk_ptr->levels[h].size < kll_capacity(sk_ptr, h)); h++);
+    kll_compact(sk_ptr, (h < sk_ptr->level_cnt) ? h : 0);
+  }
+}
+
+static void kll_compact(struct quant_sketch *sk_ptr, int h)
+{
+  /* every other item of the sorted level is promoted with twice the weight,
+     starting from a random offset; an odd item out stays behind */
+  struct kll_level *lvl_ptr = &sk_ptr->levels[h];
+  long start = lvl_ptr->size % 2;
+  uint32_t x = sk_ptr->rng_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  sk_ptr->rng_state = x;
+
+  qsort(lvl_ptr->items, (size_t) lvl_ptr->size, sizeof(double), &cmp_double);
+  for(long i = start + (long)(x & 1); i < sk_ptr->levels[h].size; i += 2){
+    kll_append(sk_ptr, h + 1, sk_ptr->levels[h].items[i]);
+  }
+  sk_ptr->levels[h].size = start;
+}
+
+static void kll_sort(struct quant_sketch *sk_ptr)
+{
+  struct kll_item *new_sorted;
+  long size = 0;
+  if(sk_ptr->sorted_valid){
+    return;
+  }
+  for(int h = 0; h < sk_ptr->level_cnt; h++){
+    size += sk_ptr->levels[h].size;
+  }
+  if(size > sk_ptr->sorted_size){
+    new_sorted = realloc(sk_ptr->sorted, (size_t) size * sizeof(struct kll_item));
+    if(!new_sorted){
+      output(erro_lvl, "failure allocating memory for quantile sketch");
+    }
+    sk_ptr->sorted = new_sorted;
+  }
+  sk_ptr->sorted_size = 0;
+  for(int h = 0; h < sk_ptr->level_cnt; h++){
+    for(long i = 0; i < sk_ptr->levels[h].size; i++){
+      sk_ptr->sorted[sk_ptr->sorted_size].value = sk_ptr->levels[h].items[i];
+      sk_ptr->sorted[sk_ptr->sorted_size].weight = UINT64_C(1) << h;
+      sk_ptr->sorted_size++;
+    }
+  }
+  qsort(sk_ptr->sorted, (size_t) sk_ptr->sorted_size, sizeof(struct kll_item), &cmp_kll_item);
+  sk_ptr->sorted_valid = 1;
+}
+
+static int cmp_double(const void *a_ptr, const void *b_ptr)
+{
+  double a = *((const double *) a_ptr);
+  double b = *((const double *) b_ptr);
+  return (a > b) - (a < b);
+}
+
+static int cmp_kll_item(const void *a_ptr, const void *b_ptr)
+{
+  return cmp_double(&((const struct kll_item *) a_ptr)->value,
+		    &((const struct kll_item *) b_ptr)->value);
+}
+
+static long hdr_index(const struct quant_sketch *sk_ptr, uint64_t units)
+{
+  long half = 1L << (sk_ptr->sub_bits - 1);
+  int shift;
+  if(units < (UINT64_C(1) << sk_ptr->sub_bits)){
+    return (long) units;
+  }
+  shift = 63 - __builtin_clzll(units) - sk_ptr->sub_bits + 1;
+  return 2 * half + (shift - 1) * half + (long)(units >> shift) - half;
+}
+
+static double hdr_value(const struct quant_sketch *sk_ptr, long idx)
+{
+  /* bucket midpoint */
+  long half = 1L << (sk_ptr->sub_bits - 1);
+  long rel_idx;
+  int shift;
+  uint64_t low;
+  if(idx < 2 * half){
+    return (double) idx * HDR_UNIT;
+  }
+  rel_idx = idx - 2 * half;
+  shift = (int)(rel_idx / half) + 1;
+  low = (uint64_t)(rel_idx % half + half) << shift;
+  return ((double) low + ldexp(1.0, shift - 1)) * HDR_UNIT;
+}
@@ -0,0 +1,83 @@
+#ifndef PSPS_QUANT_SKETCH_H
+#define PSPS_QUANT_SKETCH_H
+
+/* C standard library headers */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* quantile sketch types enumeration */
+enum sketch_type
+{
+  sketch_exact = 0,
+  sketch_kll = 1,
+  sketch_hdr = 2
+};
+
+/* quantile sketch specification structure */
+struct sketch_spec
+{
+  int type;
+  double error;
+};
+
+/* KLL weighted item structure */
+struct kll_item
+{
+  double value;
+  uint64_t weight;
+};
+
+/* KLL compactor level structure */
+struct kll_level
+{
+  double *items;
+  long size;
+  long alloc;
+};
+
+/* quantile sketch data structure, either a KLL sketch with bounded rank
+   error or a log-linear histogram with bounded relative value error */
+struct quant_sketch
+{
+  int type;
+  double error;
+  unsigned long count;
+
+  /* KLL sketch data */
+  long k;
+  int level_cnt;
+  struct kll_level *levels;
+  uint32_t rng_state;
+  struct kll_item *sorted;
+  long sorted_size;
+  int sorted_valid;
+
+  /* log-linear histogram data */
+  int sub_bits;
+  long bucket_cnt;
+  uint64_t *pos_buckets;
+  uint64_t *neg_buckets;
+};
+
+/* quantile sketch specification functions */
+void init_sketch_spec(struct sketch_spec *);
+int parse_sketch_spec(const char *, struct sketch_spec *);
+const char *sketch_type_name(int);
+
+/* quantile sketch management functions */
+void init_quant_sketch(struct quant_sketch *, const struct sketch_spec *);
+void fini_quant_sketch(struct quant_sketch *);
+void add_quant_sketch_sample(struct quant_sketch *, double);
+int merge_quant_sketch(struct quant_sketch *, const struct quant_sketch *);
+
+/* sketch files */
+int write_quant_sketch(FILE *, const struct quant_sketch *);
+int read_quant_sketch(FILE *, struct quant_sketch *);
+
+/* stats */
+unsigned long quant_sketch_count(const struct quant_sketch *);
+size_t quant_sketch_memory(const struct quant_sketch *);
+double quant_sketch_perc(struct quant_sketch *, double);
+
+#endif /* PSPS_QUANT_SKETCH_H */
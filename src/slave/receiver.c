@@ -0,0 +1,449 @@
+/* Configuration header */
+#include "../config.h"
+
+/* C standard library headers */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* POSIX library headers */
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Linux headers */
+#include <linux/errqueue.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/net_tstamp.h>
+
+/* PSP Common headers */
+#include "../common/net.h"
+#include "../common/output.h"
+#include "../common/sock_ts.h"
+
+/* PSP Slave headers */
+#include "receiver.h"
+
+/* control message buffer size */
+#define RX_CTRL_SIZE (CMSG_SPACE(sizeof(struct scm_timestamping)) + \
+		      CMSG_SPACE(sizeof(uint32_t)))
+
+/* packet ring geometry */
+#define RING_BLOCK_SIZE (1 << 16)
+#define RING_BLOCK_NR (16)
+#define RING_FRAME_SIZE (2048)
+#define RING_BLOCK_TIMEOUT_MS (1)
+#define RING_MAX_PKTS ((long) (RING_BLOCK_SIZE / TPACKET_ALIGN(sizeof(struct tpacket3_hdr) + 28)))
+
+/* functions forward declarations */
+static void update_drops(struct receiver *, struct msghdr *);
+static void init_packet_ring(struct receiver *, in_port_t);
+static void fini_packet_ring(struct receiver *);
+static long receive_ring_packets(struct receiver *);
+static int parse_ring_frame(const struct tpacket3_hdr *, struct rx_pkt *);
+static void update_ring_drops(struct receiver *);
+
+/* receiver management functions */
+void init_receiver(struct receiver *rx_ptr, int socket_desc, size_t pkt_size,
+		   const struct options *opt_ptr)
+{
+  int ovfl_enable = 1;
+  long batch;
+
+  rx_ptr->socket_desc = socket_desc;
+  rx_ptr->kernel_ts = kernel_ts_disabled;
+  rx_ptr->batch = opt_ptr->rx_batch;
+  rx_ptr->busy_poll = opt_ptr->busy_poll >= 0;
+  rx_ptr->dma_lat_desc = -1;
+  rx_ptr->buff_size = pkt_size + 1; /* +1 is needed to detect packets
+                                       longer than valid ones */
+  rx_ptr->kernel_drops = 0;
+  rx_ptr->drops = 0;
+  rx_ptr->stop = 0;
+  rx_ptr->ring = opt_ptr->packet_ring;
+  rx_ptr->ring_desc = -1;
+  rx_ptr->ring_map = NULL;
+  rx_ptr->ring_held_block = NULL;
+  rx_ptr->buffs = NULL;
+  rx_ptr->ctrl_buffs = NULL;
+  rx_ptr->iovs = NULL;
+  rx_ptr->msgs = NULL;
+
+  /* kernel receive timestamps initialization */
+  if(rx_ptr->ring){
+    init_packet_ring(rx_ptr, opt_ptr->slave_port);
+    rx_ptr->kernel_ts = kernel_ts_packet_ring;
+  }else if(opt_ptr->kernel_ts){
+    int ts_flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    int ts_enable = 1;
+    if(setsockopt(socket_desc, SOL_SOCKET, SO_TIMESTAMPING,
+		  &ts_flags, sizeof(ts_flags)) == 0){
+      rx_ptr->kernel_ts = kernel_ts_timestamping;
+    }else if(setsockopt(socket_desc, SOL_SOCKET, SO_TIMESTAMPNS,
+			&ts_enable, sizeof(ts_enable)) == 0){
+      output(warn_lvl, "SO_TIMESTAMPING not available, falling back to SO_TIMESTAMPNS");
+      rx_ptr->kernel_ts = kernel_ts_timestampns;
+    }else{
+      output(warn_lvl, "kernel receive timestamps not available, falling back to clock reads");
+    }
+  }
+
+  /* drop accounting initialization */
+  if(!rx_ptr->ring && (setsockopt(socket_desc, SOL_SOCKET, SO_RXQ_OVFL,
+				  &ovfl_enable, sizeof(ovfl_enable)) == -1)){
+    output(warn_lvl, "socket drop accounting not available");
+  }
+
+  /* busy-poll initialization */
+  if(rx_ptr->busy_poll){
+    int busy_poll_us = (int) opt_ptr->busy_poll;
+    int32_t dma_lat = 0;
+    if((busy_poll_us > 0) &&
+       (setsockopt(socket_desc, SOL_SOCKET, SO_BUSY_POLL,
+		   &busy_poll_us, sizeof(busy_poll_us)) == -1)){
+      output(warn_lvl, "failure setting socket busy-poll time: %s", strerror(errno));
+    }
+    rx_ptr->dma_lat_desc = open("/dev/cpu_dma_latency", O_WRONLY);
+    if(rx_ptr->dma_lat_desc == -1){
+      output(warn_lvl, "cannot open /dev/cpu_dma_latency: %s", strerror(errno));
+    }else if(write(rx_ptr->dma_lat_desc, &dma_lat, sizeof(dma_lat)) != sizeof(dma_lat)){
+      output(warn_lvl, "failure setting CPU DMA latency: %s", strerror(errno));
+    }
+  }
+
+  /* batch buffers initialization, frames are read in place from the packet ring */
+  if(rx_ptr->ring){
+    rx_ptr->pkts = malloc((size_t)RING_MAX_PKTS * sizeof(struct rx_pkt));
+    if(!rx_ptr->pkts){
+      output(erro_lvl, "cannot allocate buffers for timestamp packets reception");
+    }
+    return;
+  }
+  batch = rx_ptr->batch;
+  rx_ptr->buffs = malloc((size_t)batch * rx_ptr->buff_size);
+  rx_ptr->ctrl_buffs = malloc((size_t)batch * RX_CTRL_SIZE);
+  rx_ptr->iovs = malloc((size_t)batch * sizeof(struct iovec));
+  rx_ptr->msgs = malloc((size_t)batch * sizeof(struct mmsghdr));
+  rx_ptr->pkts = malloc((size_t)batch * sizeof(struct rx_pkt));
+  if(!rx_ptr->buffs || !rx_ptr->ctrl_buffs || !rx_ptr->iovs ||
+     !rx_ptr->msgs || !rx_ptr->pkts){
+    output(erro_lvl, "cannot allocate buffers for timestamp packets reception");
+  }
+  memset(rx_ptr->msgs, 0, (size_t)batch * sizeof(struct mmsghdr));
+  for(long i = 0; i < batch; i++){
+    rx_ptr->pkts[i].buff = rx_ptr->buffs + i * rx_ptr->buff_size;
+    rx_ptr->iovs[i].iov_base = rx_ptr->pkts[i].buff;
+    rx_ptr->iovs[i].iov_len = rx_ptr->buff_size;
+    rx_ptr->msgs[i].msg_hdr.msg_name = &rx_ptr->pkts[i].addr;
+    rx_ptr->msgs[i].msg_hdr.msg_iov = &rx_ptr->iovs[i];
+    rx_ptr->msgs[i].msg_hdr.msg_iovlen = 1;
+    rx_ptr->msgs[i].msg_hdr.msg_control = rx_ptr->ctrl_buffs + i * RX_CTRL_SIZE;
+  }
+}
+
+void stop_receiver(struct receiver *rx_ptr)
+{
+  __atomic_store_n(&rx_ptr->stop, 1, __ATOMIC_RELAXED);
+}
+
+void fini_receiver(struct receiver *rx_ptr)
+{
+  if(rx_ptr->ring){
+    fini_packet_ring(rx_ptr);
+  }
+  if(rx_ptr->drops){
+    output(warn_lvl, "%lu packets dropped due to socket buffer overflow", rx_ptr->drops);
+  }
+  free(rx_ptr->buffs);
+  free(rx_ptr->ctrl_buffs);
+  free(rx_ptr->iovs);
+  free(rx_ptr->msgs);
+  free(rx_ptr->pkts);
+  if((rx_ptr->dma_lat_desc != -1) && (close(rx_ptr->dma_lat_desc) == -1)){
+    output(erro_lvl, "failure closing /dev/cpu_dma_latency");
+  }
+}
+
+long receive_packets(struct receiver *rx_ptr)
+{
+  struct timespec ts;
+  int res;
+
+  if(rx_ptr->ring){
+    return receive_ring_packets(rx_ptr);
+  }
+  for(long i = 0; i < rx_ptr->batch; i++){
+    rx_ptr->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+    rx_ptr->msgs[i].msg_hdr.msg_controllen = RX_CTRL_SIZE;
+  }
+  do{
+    errno = 0;
+    res = recvmmsg(rx_ptr->socket_desc, rx_ptr->msgs, (unsigned int)rx_ptr->batch,
+		   rx_ptr->busy_poll ? MSG_DONTWAIT : MSG_WAITFORONE, NULL);
+  }while(rx_ptr->busy_poll && (res == -1) && (errno == EAGAIN));
+  if(clock_gettime(CLOCK_REALTIME, &ts) == -1){
+    output(erro_lvl, "failure reading time: %s", strerror(errno));
+  }else if(res == -1){
+    if((errno != EINTR) && (errno != EAGAIN)){
+      output(erro_lvl, "recvmmsg failure: %s", strerror(errno));
+    }
+    return 0;
+  }
+
+  if(res > 1){
+    output(debg_lvl, "received batch of %d packets", res);
+  }
+  for(int i = 0; i < res; i++){
+    struct rx_pkt *pkt_ptr = &rx_ptr->pkts[i];
+    pkt_ptr->size = rx_ptr->msgs[i].msg_len;
+    pkt_ptr->user_ts = ts;
+    pkt_ptr->rx_ts = ts;
+    if(rx_ptr->kernel_ts && !read_ts_cmsg(&rx_ptr->msgs[i].msg_hdr, &pkt_ptr->rx_ts)){
+      output(debg_lvl, "no kernel receive timestamp, using clock time");
+    }
+    update_drops(rx_ptr, &rx_ptr->msgs[i].msg_hdr);
+  }
+  return res;
+}
+
+int decode_rx_pkt(const struct rx_pkt *pkt_ptr, const struct mac_context *mac_ptr,
+		  struct rx_filter *flt_ptr, struct rx_sample *sample_ptr)
+{
+  /* cheap checks come first, the MAC is only computed for plausible packets */
+  char addr_str[SOCKADDR_STR_LEN];
+  int type;
+  type = ts_pkt_type(pkt_ptr->buff, pkt_ptr->size, mac_ptr);
+  if(type == -1){
+    flt_ptr->size_drops++;
+    output(debg_lvl, "discarded packet due to invalid size");
+    return 0;
+  }else if(!check_rx_source(flt_ptr, &pkt_ptr->addr)){
+    output(debg_lvl, "discarded packet due to source filtering");
+    return 0;
+  }else if(!check_rx_idx(flt_ptr, type, peek_ts_pkt_idx(pkt_ptr->buff, pkt_ptr->size, mac_ptr))){
+    output(debg_lvl, "discarded packet due to idx outside of the window");
+    return 0;
+  }else if(!read_ts_pkt(pkt_ptr->buff, pkt_ptr->size, mac_ptr, &sample_ptr->pkt)){
+    flt_ptr->mac_drops++;
+    output(debg_lvl, "discarded packet due to MAC mismatch");
+    return 0;
+  }
+  /* the source is only formatted for accepted packets, so that flood
+     traffic does not pay for the name lookup */
+  output(debg_lvl, "received packet from %s",
+	 sockaddr_to_str(&pkt_ptr->addr, addr_str, sizeof(addr_str)));
+  accept_rx_idx(flt_ptr, sample_ptr->pkt.idx);
+  sample_ptr->rx_ts = pkt_ptr->rx_ts;
+  sample_ptr->user_ts = pkt_ptr->user_ts;
+  return 1;
+}
+
+/* stats */
+unsigned long receiver_drops(const struct receiver *rx_ptr)
+{
+  return rx_ptr->drops;
+}
+
+/* helper functions */
+static void update_drops(struct receiver *rx_ptr, struct msghdr *msg_ptr)
+{
+  struct cmsghdr *cmsg;
+  uint32_t kernel_drops;
+  for(cmsg = CMSG_FIRSTHDR(msg_ptr); cmsg; cmsg = CMSG_NXTHDR(msg_ptr, cmsg)){
+    if((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SO_RXQ_OVFL)){
+      memcpy(&kernel_drops, CMSG_DATA(cmsg), sizeof(kernel_drops));
+      if(kernel_drops != rx_ptr->kernel_drops){
+	uint32_t new_drops = kernel_drops - rx_ptr->kernel_drops;
+	output(warn_lvl, "%u packets dropped due to socket buffer overflow", new_drops);
+	rx_ptr->drops += new_drops;
+	rx_ptr->kernel_drops = kernel_drops;
+      }
+    }
+  }
+}
+
+static void init_packet_ring(struct receiver *rx_ptr, in_port_t port)
+{
+  struct sock_filter ring_code[] = {
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t) (SKF_AD_OFF + SKF_AD_PKTTYPE)),
+    BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, PACKET_MULTICAST, 8, 0),
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 6),
+    BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 6),
+    BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 4, 0),
+    BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+    BPF_STMT(BPF_LD | BPF_H | BPF_IND, 2),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohs(port), 0, 1),
+    BPF_STMT(BPF_RET | BPF_K, 0x40000),
+    BPF_STMT(BPF_RET | BPF_K, 0)
+  };
+  struct sock_filter drop_code[] = {
+    BPF_STMT(BPF_RET | BPF_K, 0)
+  };
+  struct sock_fprog ring_prog = {sizeof(ring_code) / sizeof(ring_code[0]), ring_code};
+  struct sock_fprog drop_prog = {sizeof(drop_code) / sizeof(drop_code[0]), drop_code};
+  struct tpacket_req3 req;
+  struct sockaddr_ll ring_addr;
+  int version = TPACKET_V3;
+
+  memset(&req, 0, sizeof(req));
+  req.tp_block_size = RING_BLOCK_SIZE;
+  req.tp_block_nr = RING_BLOCK_NR;
+  req.tp_frame_size = RING_FRAME_SIZE;
+  req.tp_frame_nr = (RING_BLOCK_SIZE / RING_FRAME_SIZE) * RING_BLOCK_NR;
+  req.tp_retire_blk_tov = RING_BLOCK_TIMEOUT_MS;
+  rx_ptr->ring_size = (size_t) RING_BLOCK_SIZE * RING_BLOCK_NR;
+  rx_ptr->ring_block_idx = 0;
+
+  memset(&ring_addr, 0, sizeof(ring_addr));
+  ring_addr.sll_family = AF_PACKET;
+  ring_addr.sll_protocol = htons(ETH_P_IP);
+  ring_addr.sll_ifindex = 0;
+
+  rx_ptr->ring_desc = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_IP));
+  if(rx_ptr->ring_desc == -1){
+    output(erro_lvl, "failure creating packet socket: %s", strerror(errno));
+  }else if(setsockopt(rx_ptr->ring_desc, SOL_SOCKET, SO_ATTACH_FILTER,
+		      &ring_prog, sizeof(ring_prog)) == -1){
+    output(erro_lvl, "failure attaching filter to packet socket: %s", strerror(errno));
+  }else if(setsockopt(rx_ptr->ring_desc, SOL_PACKET, PACKET_VERSION,
+		      &version, sizeof(version)) == -1){
+    output(erro_lvl, "failure setting packet socket version: %s", strerror(errno));
+  }else if(setsockopt(rx_ptr->ring_desc, SOL_PACKET, PACKET_RX_RING,
+		      &req, sizeof(req)) == -1){
+    output(erro_lvl, "failure setting packet socket ring: %s", strerror(errno));
+  }
+
+  rx_ptr->ring_map = mmap(NULL, rx_ptr->ring_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED, rx_ptr->ring_desc, 0);
+  if(rx_ptr->ring_map == MAP_FAILED){
+    rx_ptr->ring_map = NULL;
+    output(erro_lvl, "failure mapping packet socket ring: %s", strerror(errno));
+  }else if(bind(rx_ptr->ring_desc, (struct sockaddr *) &ring_addr, sizeof(ring_addr)) == -1){
+    output(erro_lvl, "failure binding packet socket: %s", strerror(errno));
+  }else if(setsockopt(rx_ptr->socket_desc, SOL_SOCKET, SO_ATTACH_FILTER,
+		      &drop_prog, sizeof(drop_prog)) == -1){
+    output(erro_lvl, "failure attaching filter to UDP socket: %s", strerror(errno));
+  }
+}
+
+static void fini_packet_ring(struct receiver *rx_ptr)
+{
+  if(rx_ptr->ring_desc != -1){
+    update_ring_drops(rx_ptr);
+  }
+  if(rx_ptr->ring_map && (munmap(rx_ptr->ring_map, rx_ptr->ring_size) == -1)){
+    output(erro_lvl, "failure unmapping packet socket ring");
+  }
+  if((rx_ptr->ring_desc != -1) && (close(rx_ptr->ring_desc) == -1)){
+    output(erro_lvl, "failure closing packet socket");
+  }
+}
+
+static long receive_ring_packets(struct receiver *rx_ptr)
+{
+  struct tpacket_block_desc *block;
+  struct tpacket3_hdr *frame;
+  struct timespec ts;
+  struct pollfd pfd;
+  long count = 0;
+
+  if(rx_ptr->ring_held_block){
+    __atomic_store_n(&rx_ptr->ring_held_block->hdr.bh1.block_status,
+		     TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    rx_ptr->ring_held_block = NULL;
+    rx_ptr->ring_block_idx = (rx_ptr->ring_block_idx + 1) % RING_BLOCK_NR;
+  }
+
+  block = (struct tpacket_block_desc *) (rx_ptr->ring_map +
+					 (size_t) rx_ptr->ring_block_idx * RING_BLOCK_SIZE);
+  while(!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+	  TP_STATUS_USER)){
+    if(__atomic_load_n(&rx_ptr->stop, __ATOMIC_RELAXED)){
+      return 0;
+    }
+    if(!rx_ptr->busy_poll){
+      pfd.fd = rx_ptr->ring_desc;
+      pfd.events = POLLIN | POLLERR;
+      pfd.revents = 0;
+      errno = 0;
+      if(poll(&pfd, 1, -1) == -1){
+	if(errno != EINTR){
+	  output(erro_lvl, "poll failure: %s", strerror(errno));
+	}
+	return 0;
+      }
+    }
+  }
+  if(clock_gettime(CLOCK_REALTIME, &ts) == -1){
+    output(erro_lvl, "failure reading time: %s", strerror(errno));
+  }
+  rx_ptr->ring_held_block = block;
+
+  if(block->hdr.bh1.block_status & TP_STATUS_LOSING){
+    update_ring_drops(rx_ptr);
+  }
+  output(debg_lvl, "received block of %u packets, first: %u.%09u last: %u.%09u",
+	 block->hdr.bh1.num_pkts,
+	 block->hdr.bh1.ts_first_pkt.ts_sec, block->hdr.bh1.ts_first_pkt.ts_nsec,
+	 block->hdr.bh1.ts_last_pkt.ts_sec, block->hdr.bh1.ts_last_pkt.ts_nsec);
+
+  frame = (struct tpacket3_hdr *) ((uint8_t *) block + block->hdr.bh1.offset_to_first_pkt);
+  for(uint32_t i = 0; (i < block->hdr.bh1.num_pkts) && (count < RING_MAX_PKTS); i++){
+    if(parse_ring_frame(frame, &rx_ptr->pkts[count])){
+      rx_ptr->pkts[count].user_ts = ts;
+      count++;
+    }
+    frame = (struct tpacket3_hdr *) ((uint8_t *) frame + frame->tp_next_offset);
+  }
+  return count;
+}
+
+static int parse_ring_frame(const struct tpacket3_hdr *frame, struct rx_pkt *pkt_ptr)
+{
+  uint8_t *ip_hdr = (uint8_t *) frame + frame->tp_net;
+  size_t len = frame->tp_snaplen - (frame->tp_net - frame->tp_mac);
+  size_t ihl;
+  uint8_t *udp_hdr;
+  uint16_t udp_len;
+  struct sockaddr_in *src_ptr;
+
+  if((len < 20) || ((ip_hdr[0] >> 4) != 4)){
+    return 0;
+  }
+  ihl = (size_t) (ip_hdr[0] & 0x0f) * 4;
+  if((ihl < 20) || (len < ihl + 8) || (ip_hdr[9] != IPPROTO_UDP)){
+    return 0;
+  }
+  udp_hdr = ip_hdr + ihl;
+  memcpy(&udp_len, udp_hdr + 4, sizeof(udp_len));
+  udp_len = ntohs(udp_len);
+  if((udp_len < 8) || (ihl + udp_len > len)){
+    return 0;
+  }
+  pkt_ptr->buff = udp_hdr + 8;
+  pkt_ptr->size = (size_t) udp_len - 8;
+  src_ptr = (struct sockaddr_in *) &pkt_ptr->addr;
+  src_ptr->sin_family = AF_INET;
+  memcpy(&src_ptr->sin_addr, ip_hdr + 12, sizeof(src_ptr->sin_addr));
+  memcpy(&src_ptr->sin_port, udp_hdr, sizeof(src_ptr->sin_port));
+  pkt_ptr->rx_ts.tv_sec = (time_t) frame->tp_sec;
+  pkt_ptr->rx_ts.tv_nsec = (long) frame->tp_nsec;
+  return 1;
+}
+
+static void update_ring_drops(struct receiver *rx_ptr)
+{
+  struct tpacket_stats_v3 stats;
+  socklen_t len = sizeof(stats);
+  if(getsockopt(rx_ptr->ring_desc, SOL_PACKET, PACKET_STATISTICS, &stats, &len) == 0){
+    if(stats.tp_drops){
+      output(warn_lvl, "%u packets dropped due to packet ring overflow", stats.tp_drops);
+      rx_ptr->drops += stats.tp_drops;
+    }
+  }
+}
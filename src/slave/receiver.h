@@ -0,0 +1,89 @@
+#ifndef PSPS_RECEIVER_H
+#define PSPS_RECEIVER_H
+
+/* C standard library headers */
+#include <stdint.h>
+#include <time.h>
+
+/* POSIX library headers */
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+/* Linux headers */
+#include <linux/if_packet.h>
+
+/* PSP Common headers */
+#include "../common/mac.h"
+#include "../common/timestamp.h"
+
+/* PSP Slave headers */
+#include "options.h"
+#include "rx_filter.h"
+
+/* kernel receive timestamping values enumeration */
+enum kernel_ts_value
+{
+  kernel_ts_disabled = 0,
+  kernel_ts_timestamping = 1,
+  kernel_ts_timestampns = 2,
+  kernel_ts_packet_ring = 3
+};
+
+/* received packet structure */
+struct rx_pkt
+{
+  uint8_t *buff;
+  size_t size;
+  struct sockaddr_storage addr;
+  struct timespec rx_ts;
+  struct timespec user_ts;
+};
+
+/* decoded timestamp packet structure */
+struct rx_sample
+{
+  struct ts_pkt pkt;
+  struct timespec rx_ts;
+  struct timespec user_ts;
+};
+
+/* receiver data structure */
+struct receiver
+{
+  int socket_desc;
+  int kernel_ts;
+  long batch;
+  int busy_poll;
+  int dma_lat_desc;
+  size_t buff_size;
+  uint8_t *buffs;
+  char *ctrl_buffs;
+  struct iovec *iovs;
+  struct mmsghdr *msgs;
+  struct rx_pkt *pkts;
+  uint32_t kernel_drops;
+  unsigned long drops;
+  int stop;
+
+  /* packet ring data */
+  int ring;
+  int ring_desc;
+  uint8_t *ring_map;
+  size_t ring_size;
+  unsigned int ring_block_idx;
+  struct tpacket_block_desc *ring_held_block;
+};
+
+/* receiver management functions */
+void init_receiver(struct receiver *, int, size_t, const struct options *);
+void stop_receiver(struct receiver *);
+void fini_receiver(struct receiver *);
+long receive_packets(struct receiver *);
+int decode_rx_pkt(const struct rx_pkt *, const struct mac_context *, struct rx_filter *,
+		  struct rx_sample *);
+
+/* stats */
+unsigned long receiver_drops(const struct receiver *);
+
+#endif /* PSPS_RECEIVER_H */
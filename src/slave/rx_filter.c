@@ -0,0 +1,365 @@
+/* Configuration header */
+#include "../config.h"
+
+/* C standard library headers */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* POSIX library headers */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+/* Linux headers */
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+
+/* PSP Common headers */
+#include "../common/net.h"
+#include "../common/output.h"
+
+/* PSP Slave headers */
+#include "rx_filter.h"
+
+/* rate limiting buckets geometry */
+#define RX_BUCKETS (64)
+#define RX_BUCKET_PROBES (4)
+
+/* consecutive forward index rejections before a resynchronization attempt */
+#define RX_IDX_RESYNC_REJECTS (8)
+
+/* UDP header length */
+#define UDP_HDR_LEN (8)
+
+/* functions forward declarations */
+static void read_allowlist(struct rx_filter *, const char *);
+static void normalize_addr(const struct sockaddr_storage *, struct sockaddr_storage *);
+static int same_addr(const struct sockaddr_storage *, const struct sockaddr_storage *);
+static unsigned long hash_addr(const struct sockaddr_storage *);
+static struct rx_bucket *find_bucket(struct rx_filter *, const struct sockaddr_storage *,
+				     const struct timespec *);
+static void add_insn(struct sock_filter *, unsigned int *, struct sock_filter);
+
+/* reception filter management functions */
+void init_rx_filter(struct rx_filter *flt_ptr, const struct options *opt_ptr)
+{
+  memset(flt_ptr, 0, sizeof(*flt_ptr));
+  flt_ptr->window = opt_ptr->idx_window;
+  if(opt_ptr->allowlist_filename){
+    read_allowlist(flt_ptr, opt_ptr->allowlist_filename);
+  }
+  flt_ptr->rate = (double) opt_ptr->rate_limit;
+  if(opt_ptr->rate_limit > 0){
+    /* a whole burst of sync packets and their follow-ups shall fit in the
+       bucket, so that the least delayed packet is selected from all of them */
+    flt_ptr->burst = (flt_ptr->rate > 2.0 * TS_PKT_MAX_BURST) ? flt_ptr->rate : 2.0 * TS_PKT_MAX_BURST;
+    flt_ptr->buckets = calloc(RX_BUCKETS, sizeof(*flt_ptr->buckets));
+    if(!flt_ptr->buckets){
+      output(erro_lvl, "cannot allocate rate limiting buckets");
+    }
+  }
+}
+
+void attach_rx_filter(const struct rx_filter *flt_ptr, int socket_desc,
+		      const size_t *sizes, int size_cnt)
+{
+  /* the socket filter sees the datagram from the UDP header, the source
+     address is read from the network header through SKF_NET_OFF */
+  const uint32_t src4_off = (uint32_t) (SKF_NET_OFF + 12);
+  const uint32_t src6_off = (uint32_t) (SKF_NET_OFF + 8);
+  const uint32_t accept = 0x40000;
+  struct sock_filter *code;
+  struct sock_fprog prog;
+  unsigned int len = 0;
+  unsigned int v6_jump;
+  long i;
+
+  code = calloc(BPF_MAXINSNS, sizeof(*code));
+  if(!code){
+    output(erro_lvl, "cannot allocate socket filter");
+  }
+  add_insn(code, &len, (struct sock_filter) BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 4));
+  for(i = 0; i < size_cnt; i++){
+    add_insn(code, &len, (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+						       (uint32_t) (UDP_HDR_LEN + sizes[i]),
+						       (uint8_t) (size_cnt - i), 0));
+  }
+  add_insn(code, &len, (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0));
+  if(flt_ptr->allowed_cnt && (flt_ptr->allowed_cnt * 10 + 16 < BPF_MAXINSNS)){
+    /* each allowed address accepts the packet on match, long jumps use BPF_JA */
+    add_insn(code, &len, (struct sock_filter) BPF_STMT(BPF_LD | BPF_H | BPF_ABS,
+							(uint32_t) (SKF_AD_OFF + SKF_AD_PROTOCOL)));
+    add_insn(code, &len, (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 1, 0));
+    v6_jump = len;
+    add_insn(code, &len, (struct sock_filter) BPF_STMT(BPF_JMP | BPF_JA, 0));
+    add_insn(code, &len, (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, src4_off));
+    for(i = 0; i < flt_ptr->allowed_cnt; i++){
+      const struct sockaddr_in *sin = (const struct sockaddr_in *) &flt_ptr->allowed[i];
+      if(sin->sin_family == AF_INET){
+	add_insn(code, &len, (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+							   ntohl(sin->sin_addr.s_addr), 0, 1));
+	add_insn(code, &len, (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, accept));
+      }
+    }
+    add_insn(code, &len, (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0));
+    code[v6_jump].k = len - v6_jump - 1;
+    for(i = 0; i < flt_ptr->allowed_cnt; i++){
+      const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *) &flt_ptr->allowed[i];
+      if(sin6->sin6_family == AF_INET6){
+	for(int w = 0; w < 4; w++){
+	  uint32_t word;
+	  memcpy(&word, sin6->sin6_addr.s6_addr + 4 * w, sizeof(word));
+	  add_insn(code, &len, (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+							      src6_off + 4 * (uint32_t) w));
+	  add_insn(code, &len, (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohl(word),
+							     0, (uint8_t) (2 * (3 - w) + 1)));
+	}
+	add_insn(code, &len, (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, accept));
+      }
+    }
+    add_insn(code, &len, (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0));
+  }else{
+    if(flt_ptr->allowed_cnt){
+      output(warn_lvl, "source allowlist too long for the socket filter, checked in user space only");
+    }
+    add_insn(code, &len, (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, accept));
+  }
+
+  prog.len = (unsigned short) len;
+  prog.filter = code;
+  if(setsockopt(socket_desc, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) == -1){
+    free(code);
+    output(erro_lvl, "failure attaching filter to UDP socket: %s", strerror(errno));
+  }
+  free(code);
+  output(debg_lvl, "socket filter attached (%u instructions)", len);
+}
+
+void fini_rx_filter(struct rx_filter *flt_ptr)
+{
+  if(flt_ptr->size_drops || flt_ptr->source_drops || flt_ptr->rate_drops ||
+     flt_ptr->idx_drops || flt_ptr->mac_drops){
+    output(info_lvl, "discarded packets: size %lu, source %lu, rate %lu, index %lu, MAC %lu",
+	   flt_ptr->size_drops, flt_ptr->source_drops, flt_ptr->rate_drops,
+	   flt_ptr->idx_drops, flt_ptr->mac_drops);
+  }
+  free(flt_ptr->allowed);
+  free(flt_ptr->buckets);
+  flt_ptr->allowed = NULL;
+  flt_ptr->buckets = NULL;
+}
+
+/* packet checks, performed before MAC verification */
+int check_rx_source(struct rx_filter *flt_ptr, const struct sockaddr_storage *addr_ptr)
+{
+  struct sockaddr_storage addr;
+  struct rx_bucket *bkt_ptr;
+  struct timespec now;
+  double elapsed;
+  long i;
+
+  if(!flt_ptr->allowed_cnt && (flt_ptr->rate <= 0)){
+    return 1;
+  }
+  normalize_addr(addr_ptr, &addr);
+  if(flt_ptr->allowed_cnt){
+    for(i = 0; (i < flt_ptr->allowed_cnt) && !same_addr(&flt_ptr->allowed[i], &addr); i++);
+    if(i == flt_ptr->allowed_cnt){
+      flt_ptr->source_drops++;
+      return 0;
+    }
+  }
+  if(flt_ptr->rate > 0){
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    bkt_ptr = find_bucket(flt_ptr, &addr, &now);
+    elapsed = (double) (now.tv_sec - bkt_ptr->last.tv_sec) +
+      (double) (now.tv_nsec - bkt_ptr->last.tv_nsec) * 1e-9;
+    bkt_ptr->last = now;
+    bkt_ptr->tokens += elapsed * flt_ptr->rate;
+    if(bkt_ptr->tokens > flt_ptr->burst){
+      bkt_ptr->tokens = flt_ptr->burst;
+    }
+    if(bkt_ptr->tokens < 1.0){
+      flt_ptr->rate_drops++;
+      return 0;
+    }
+    bkt_ptr->tokens -= 1.0;
+  }
+  return 1;
+}
+
+int check_rx_idx(struct rx_filter *flt_ptr, int type, ts_pkt_idx_t idx)
+{
+  /* the first authenticated packet sets the reference index */
+  int valid;
+  flt_ptr->idx_resync = 0;
+  if(!flt_ptr->last_idx){
+    return 1;
+  }
+  if(type == ts_pkt_follow_up){
+    valid = idx == flt_ptr->last_idx;
+  }else{
+    valid = (idx > flt_ptr->last_idx) &&
+      (!flt_ptr->window || ((long) (idx - flt_ptr->last_idx) <= flt_ptr->window));
+    if(!valid && (idx > flt_ptr->last_idx) &&
+       (++flt_ptr->idx_rejects >= RX_IDX_RESYNC_REJECTS)){
+      /* after a loss longer than the window or a master restart every index
+	 is ahead of it, so one out of a few rejected indexes goes on to MAC
+	 verification and becomes the new reference if it passes */
+      flt_ptr->idx_rejects = 0;
+      flt_ptr->idx_resync = 1;
+      return 1;
+    }
+  }
+  if(!valid){
+    flt_ptr->idx_drops++;
+  }
+  return valid;
+}
+
+void accept_rx_idx(struct rx_filter *flt_ptr, ts_pkt_idx_t idx)
+{
+  if(flt_ptr->idx_resync){
+    output(warn_lvl, "packet index window resynchronized from %09lu to %09lu",
+	   (unsigned long) flt_ptr->last_idx, (unsigned long) idx);
+    flt_ptr->idx_resync = 0;
+  }
+  flt_ptr->idx_rejects = 0;
+  if(idx > flt_ptr->last_idx){
+    flt_ptr->last_idx = idx;
+  }
+}
+
+/* helper functions */
+static void read_allowlist(struct rx_filter *flt_ptr, const char *filename)
+{
+  struct sockaddr_storage *new_allowed;
+  long size = 0;
+  long line_num = 0;
+  char line[256];
+  char *addr_str;
+
+  FILE *file_ptr = fopen(filename, "r");
+  if(!file_ptr){
+    output(erro_lvl, "cannot open allowlist file '%s' for reading", filename);
+  }
+  while(fgets(line, sizeof(line), file_ptr)){
+    line_num++;
+    addr_str = strtok(line, " \t\r\n");
+    if(!addr_str || (*addr_str == '#')){
+      continue;
+    }
+    if(flt_ptr->allowed_cnt == size){
+      size = size ? size * 2 : 16;
+      new_allowed = realloc(flt_ptr->allowed, size * sizeof(*new_allowed));
+      if(!new_allowed){
+	fclose(file_ptr);
+	output(erro_lvl, "cannot allocate source allowlist");
+      }
+      flt_ptr->allowed = new_allowed;
+    }
+    if(!parse_sockaddr(addr_str, &flt_ptr->allowed[flt_ptr->allowed_cnt])){
+      fclose(file_ptr);
+      output(erro_lvl, "invalid address at line %ld of allowlist file '%s'", line_num, filename);
+    }
+    normalize_addr(&flt_ptr->allowed[flt_ptr->allowed_cnt],
+		   &flt_ptr->allowed[flt_ptr->allowed_cnt]);
+    flt_ptr->allowed_cnt++;
+  }
+  if(fclose(file_ptr) == EOF){
+    output(erro_lvl, "failure closing allowlist file '%s'", filename);
+  }
+  if(!flt_ptr->allowed_cnt){
+    output(erro_lvl, "allowlist file '%s' contains no address", filename);
+  }
+  output(debg_lvl, "%ld allowed source addresses loaded", flt_ptr->allowed_cnt);
+}
+
+static void normalize_addr(const struct sockaddr_storage *src_ptr, struct sockaddr_storage *dst_ptr)
+{
+  /* IPv4 sources received on dual-stack sockets appear as IPv4-mapped IPv6 addresses */
+  struct sockaddr_storage tmp;
+  memset(&tmp, 0, sizeof(tmp));
+  if(src_ptr->ss_family == AF_INET6){
+    const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *) src_ptr;
+    if(IN6_IS_ADDR_V4MAPPED(&sin6->sin6_addr)){
+      struct sockaddr_in *sin = (struct sockaddr_in *) &tmp;
+      sin->sin_family = AF_INET;
+      memcpy(&sin->sin_addr, sin6->sin6_addr.s6_addr + 12, 4);
+    }else{
+      struct sockaddr_in6 *dst6 = (struct sockaddr_in6 *) &tmp;
+      dst6->sin6_family = AF_INET6;
+      dst6->sin6_addr = sin6->sin6_addr;
+    }
+  }else if(src_ptr->ss_family == AF_INET){
+    struct sockaddr_in *sin = (struct sockaddr_in *) &tmp;
+    sin->sin_family = AF_INET;
+    sin->sin_addr = ((const struct sockaddr_in *) src_ptr)->sin_addr;
+  }
+  memcpy(dst_ptr, &tmp, sizeof(tmp));
+}
+
+static int same_addr(const struct sockaddr_storage *a_ptr, const struct sockaddr_storage *b_ptr)
+{
+  if(a_ptr->ss_family != b_ptr->ss_family){
+    return 0;
+  }else if(a_ptr->ss_family == AF_INET){
+    return ((const struct sockaddr_in *) a_ptr)->sin_addr.s_addr ==
+      ((const struct sockaddr_in *) b_ptr)->sin_addr.s_addr;
+  }else{
+    return !memcmp(&((const struct sockaddr_in6 *) a_ptr)->sin6_addr,
+		   &((const struct sockaddr_in6 *) b_ptr)->sin6_addr, sizeof(struct in6_addr));
+  }
+}
+
+static unsigned long hash_addr(const struct sockaddr_storage *addr_ptr)
+{
+  const uint8_t *bytes;
+  size_t len;
+  unsigned long hash = 2166136261UL;
+  if(addr_ptr->ss_family == AF_INET){
+    bytes = (const uint8_t *) &((const struct sockaddr_in *) addr_ptr)->sin_addr;
+    len = 4;
+  }else{
+    bytes = (const uint8_t *) &((const struct sockaddr_in6 *) addr_ptr)->sin6_addr;
+    len = 16;
+  }
+  for(size_t i = 0; i < len; i++){
+    hash = (hash ^ bytes[i]) * 16777619UL;
+  }
+  return hash;
+}
+
+static struct rx_bucket *find_bucket(struct rx_filter *flt_ptr, const struct sockaddr_storage *addr_ptr,
+				     const struct timespec *now_ptr)
+{
+  /* short linear probing, the least recently used bucket is recycled */
+  unsigned long start = hash_addr(addr_ptr);
+  struct rx_bucket *bkt_ptr;
+  struct rx_bucket *oldest_ptr = NULL;
+
+  for(int i = 0; i < RX_BUCKET_PROBES; i++){
+    bkt_ptr = &flt_ptr->buckets[(start + (unsigned long) i) % RX_BUCKETS];
+    if(bkt_ptr->addr.ss_family == AF_UNSPEC){
+      oldest_ptr = bkt_ptr;
+      break;
+    }else if(same_addr(&bkt_ptr->addr, addr_ptr)){
+      return bkt_ptr;
+    }else if(!oldest_ptr || (bkt_ptr->last.tv_sec < oldest_ptr->last.tv_sec) ||
+	     ((bkt_ptr->last.tv_sec == oldest_ptr->last.tv_sec) &&
+	      (bkt_ptr->last.tv_nsec < oldest_ptr->last.tv_nsec))){
+      oldest_ptr = bkt_ptr;
+    }
+  }
+  memcpy(&oldest_ptr->addr, addr_ptr, sizeof(*addr_ptr));
+  oldest_ptr->tokens = flt_ptr->burst;
+  oldest_ptr->last = *now_ptr;
+  return oldest_ptr;
+}
+
+static void add_insn(struct sock_filter *code, unsigned int *len_ptr, struct sock_filter insn)
+{
+  code[(*len_ptr)++] = insn;
+}
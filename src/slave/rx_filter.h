@@ -0,0 +1,61 @@
+#ifndef PSPS_RX_FILTER_H
+#define PSPS_RX_FILTER_H
+
+/* C standard library headers */
+#include <stddef.h>
+#include <time.h>
+
+/* POSIX library headers */
+#include <sys/socket.h>
+
+/* PSP Common headers */
+#include "../common/timestamp.h"
+
+/* PSP Slave headers */
+#include "options.h"
+
+/* per source token bucket structure */
+struct rx_bucket
+{
+  struct sockaddr_storage addr;
+  double tokens;
+  struct timespec last;
+};
+
+/* reception filter data structure */
+struct rx_filter
+{
+  /* index window */
+  ts_pkt_idx_t last_idx;
+  long window;
+  long idx_rejects;
+  int idx_resync;
+
+  /* source allowlist */
+  struct sockaddr_storage *allowed;
+  long allowed_cnt;
+
+  /* per source rate limiting */
+  double rate;
+  double burst;
+  struct rx_bucket *buckets;
+
+  /* drop counters */
+  unsigned long size_drops;
+  unsigned long source_drops;
+  unsigned long rate_drops;
+  unsigned long idx_drops;
+  unsigned long mac_drops;
+};
+
+/* reception filter management functions */
+void init_rx_filter(struct rx_filter *, const struct options *);
+void attach_rx_filter(const struct rx_filter *, int, const size_t *, int);
+void fini_rx_filter(struct rx_filter *);
+
+/* packet checks, performed before MAC verification */
+int check_rx_source(struct rx_filter *, const struct sockaddr_storage *);
+int check_rx_idx(struct rx_filter *, int, ts_pkt_idx_t);
+void accept_rx_idx(struct rx_filter *, ts_pkt_idx_t);
+
+#endif /* PSPS_RX_FILTER_H */
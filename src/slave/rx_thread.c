@@ -0,0 +1,218 @@
+/* C standard library headers */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* POSIX library headers */
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+
+/* Linux headers */
+#include <sys/eventfd.h>
+
+/* PSP Common headers */
+#include "../common/mgmt.h"
+#include "../common/output.h"
+
+/* PSP Slave headers */
+#include "rx_thread.h"
+
+/* functions forward declarations */
+static void *rx_thread_main(void *);
+static void rx_thread_loop(void *);
+static void push_rx_sample(struct rx_thread *, const struct rx_sample *);
+static void wake_consumer(struct rx_thread *);
+static void init_rx_thread_attr(pthread_attr_t *);
+
+/* reception thread management functions */
+void init_rx_thread(struct rx_thread *thr_ptr, struct receiver *rx_ptr,
+		    const struct mac_context *mac_ptr, struct rx_filter *flt_ptr, long size)
+{
+  sigset_t block_set, old_set;
+  pthread_attr_t attr;
+  int res;
+
+  thr_ptr->rx_ptr = rx_ptr;
+  thr_ptr->mac_ptr = mac_ptr;
+  thr_ptr->flt_ptr = flt_ptr;
+  thr_ptr->size = (unsigned long) size;
+  thr_ptr->head = 0;
+  thr_ptr->tail = 0;
+  thr_ptr->sleeping = 0;
+  thr_ptr->failed = 0;
+  thr_ptr->high_water = 0;
+  thr_ptr->overflows = 0;
+  thr_ptr->running = 0;
+  thr_ptr->event_desc = -1;
+
+  thr_ptr->samples = malloc(thr_ptr->size * sizeof(struct rx_sample));
+  if(!thr_ptr->samples){
+    output(erro_lvl, "cannot allocate reception thread ring");
+  }
+  thr_ptr->event_desc = eventfd(0, EFD_CLOEXEC);
+  if(thr_ptr->event_desc == -1){
+    output(erro_lvl, "failure creating reception thread event: %s", strerror(errno));
+  }
+
+  /* SIGINT is handled by the processing thread only */
+  sigemptyset(&block_set);
+  sigaddset(&block_set, SIGINT);
+  pthread_sigmask(SIG_BLOCK, &block_set, &old_set);
+  init_rx_thread_attr(&attr);
+  res = pthread_create(&thr_ptr->thread, &attr, &rx_thread_main, thr_ptr);
+  pthread_attr_destroy(&attr);
+  pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+  if(res){
+    output(erro_lvl, "failure creating reception thread: %s", strerror(res));
+  }
+  thr_ptr->running = 1;
+  output(debg_lvl, "reception thread started with a ring of %lu samples", thr_ptr->size);
+}
+
+void fini_rx_thread(struct rx_thread *thr_ptr)
+{
+  if(thr_ptr->running){
+    stop_receiver(thr_ptr->rx_ptr);
+    pthread_cancel(thr_ptr->thread);
+    pthread_join(thr_ptr->thread, NULL);
+    thr_ptr->running = 0;
+    output(info_lvl, "reception thread ring high-water mark: %lu of %lu samples",
+	   thr_ptr->high_water, thr_ptr->size);
+  }
+  if(thr_ptr->overflows){
+    output(warn_lvl, "%lu samples dropped due to reception thread ring overflow",
+	   thr_ptr->overflows);
+  }
+  free(thr_ptr->samples);
+  thr_ptr->samples = NULL;
+  if((thr_ptr->event_desc != -1) && (close(thr_ptr->event_desc) == -1)){
+    output(erro_lvl, "failure closing reception thread event");
+  }
+  thr_ptr->event_desc = -1;
+}
+
+long pop_rx_samples(struct rx_thread *thr_ptr, struct rx_sample *samples, long max)
+{
+  unsigned long head;
+  unsigned long tail = thr_ptr->tail;
+  uint64_t value;
+  long count = 0;
+
+  head = __atomic_load_n(&thr_ptr->head, __ATOMIC_ACQUIRE);
+  if(head == tail){
+    /* announce the wait before checking the ring again, so that a sample
+       pushed meanwhile either is seen here or wakes the event up */
+    __atomic_store_n(&thr_ptr->sleeping, 1, __ATOMIC_SEQ_CST);
+    head = __atomic_load_n(&thr_ptr->head, __ATOMIC_SEQ_CST);
+    if((head == tail) && !__atomic_load_n(&thr_ptr->failed, __ATOMIC_ACQUIRE)){
+      if((read(thr_ptr->event_desc, &value, sizeof(value)) == -1) && (errno != EINTR)){
+	output(erro_lvl, "failure waiting for reception thread: %s", strerror(errno));
+      }
+    }
+    __atomic_store_n(&thr_ptr->sleeping, 0, __ATOMIC_RELAXED);
+    head = __atomic_load_n(&thr_ptr->head, __ATOMIC_ACQUIRE);
+  }
+  if((head == tail) && __atomic_load_n(&thr_ptr->failed, __ATOMIC_ACQUIRE)){
+    output(erro_lvl, "reception thread failure");
+  }
+
+  while((tail != head) && (count < max)){
+    samples[count++] = thr_ptr->samples[tail % thr_ptr->size];
+    tail++;
+  }
+  __atomic_store_n(&thr_ptr->tail, tail, __ATOMIC_RELEASE);
+  return count;
+}
+
+/* reception thread functions */
+static void *rx_thread_main(void *ptr)
+{
+  struct rx_thread *thr_ptr = (struct rx_thread *) ptr;
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+  if(!run_managed_thread(&rx_thread_loop, thr_ptr)){
+    __atomic_store_n(&thr_ptr->failed, 1, __ATOMIC_RELEASE);
+    wake_consumer(thr_ptr);
+  }
+  return NULL;
+}
+
+static void rx_thread_loop(void *ptr)
+{
+  struct rx_thread *thr_ptr = (struct rx_thread *) ptr;
+  struct rx_sample sample;
+  long count;
+  int pushed;
+
+  while(1){
+    /* the thread can be cancelled only while waiting for packets */
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    pthread_testcancel();
+    count = receive_packets(thr_ptr->rx_ptr);
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    pushed = 0;
+    for(long i = 0; i < count; i++){
+      if(decode_rx_pkt(&thr_ptr->rx_ptr->pkts[i], thr_ptr->mac_ptr, thr_ptr->flt_ptr, &sample)){
+	push_rx_sample(thr_ptr, &sample);
+	pushed = 1;
+      }
+    }
+    if(pushed){
+      wake_consumer(thr_ptr);
+    }
+  }
+}
+
+static void push_rx_sample(struct rx_thread *thr_ptr, const struct rx_sample *sample_ptr)
+{
+  unsigned long head = thr_ptr->head;
+  unsigned long tail = __atomic_load_n(&thr_ptr->tail, __ATOMIC_ACQUIRE);
+  unsigned long used = head - tail;
+
+  if(used == thr_ptr->size){
+    thr_ptr->overflows++;
+    return;
+  }
+  thr_ptr->samples[head % thr_ptr->size] = *sample_ptr;
+  __atomic_store_n(&thr_ptr->head, head + 1, __ATOMIC_SEQ_CST);
+  if(used + 1 > thr_ptr->high_water){
+    thr_ptr->high_water = used + 1;
+  }
+}
+
+static void wake_consumer(struct rx_thread *thr_ptr)
+{
+  uint64_t value = 1;
+  if(__atomic_load_n(&thr_ptr->sleeping, __ATOMIC_SEQ_CST) &&
+     (write(thr_ptr->event_desc, &value, sizeof(value)) == -1)){
+    output(erro_lvl, "failure waking up processing thread: %s", strerror(errno));
+  }
+}
+
+static void init_rx_thread_attr(pthread_attr_t *attr_ptr)
+{
+  /* under real-time scheduling the reception thread runs one priority
+     above the processing thread, so that a packet wake-up preempts the
+     processing even when both threads share a CPU; at the highest
+     priority the processing thread is lowered by one instead */
+  struct sched_param param;
+  int policy, res, max_prio;
+
+  pthread_attr_init(attr_ptr);
+  if((pthread_getschedparam(pthread_self(), &policy, &param) != 0) ||
+     ((policy != SCHED_FIFO) && (policy != SCHED_RR))){
+    return;
+  }
+  max_prio = sched_get_priority_max(policy);
+  if(param.sched_priority >= max_prio){
+    param.sched_priority = max_prio - 1;
+    if((res = pthread_setschedparam(pthread_self(), policy, &param)) != 0){
+      output(erro_lvl, "failure lowering processing thread priority: %s", strerror(res));
+    }
+  }
+  param.sched_priority++;
+  pthread_attr_setinheritsched(attr_ptr, PTHREAD_EXPLICIT_SCHED);
+  pthread_attr_setschedpolicy(attr_ptr, policy);
+  pthread_attr_setschedparam(attr_ptr, &param);
+  output(info_lvl, "reception thread running with priority %d", param.sched_priority);
+}
@@ -0,0 +1,45 @@
+#ifndef PSPS_RX_THREAD_H
+#define PSPS_RX_THREAD_H
+
+/* C standard library headers */
+#include <stdint.h>
+
+/* POSIX library headers */
+#include <pthread.h>
+
+/* PSP Slave headers */
+#include "receiver.h"
+
+/* reception thread data structure */
+struct rx_thread
+{
+  /* reception data, only used by the reception thread */
+  struct receiver *rx_ptr;
+  const struct mac_context *mac_ptr;
+  struct rx_filter *flt_ptr;
+
+  /* single-producer single-consumer sample ring */
+  struct rx_sample *samples;
+  unsigned long size;
+  unsigned long head;
+  unsigned long tail;
+  int event_desc;
+  int sleeping;
+  int failed;
+
+  /* ring statistics */
+  unsigned long high_water;
+  unsigned long overflows;
+
+  /* thread data */
+  pthread_t thread;
+  int running;
+};
+
+/* reception thread management functions */
+void init_rx_thread(struct rx_thread *, struct receiver *, const struct mac_context *,
+		    struct rx_filter *, long);
+void fini_rx_thread(struct rx_thread *);
+long pop_rx_samples(struct rx_thread *, struct rx_sample *, long);
+
+#endif /* PSPS_RX_THREAD_H */
@@ -0,0 +1,210 @@
+/* Configuration header */
+#include "../config.h"
+
+/* C standard library headers */
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* POSIX library headers */
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* PSP Common headers */
+#include "../common/output.h"
+
+/* PSP Slave headers */
+#include "sample_store.h"
+
+/* samples added to the file each time it grows */
+#define STORE_CHUNK_SAMPLES (1L << 20)
+
+/* bits of the sample keys resolved by each selection pass */
+#define SELECT_DIGIT_BITS 11
+
+/* functions forward declarations */
+static void map_store(struct sample_store *, long);
+static uint64_t sample_key(double);
+static double key_sample(uint64_t);
+static int find_group(const uint64_t *, int, uint64_t);
+
+/* sample store management functions */
+void init_sample_store(struct sample_store *st_ptr, FILE *file_ptr)
+{
+  st_ptr->file_ptr = file_ptr;
+  st_ptr->map = NULL;
+  st_ptr->map_size = 0;
+  st_ptr->count = 0;
+  st_ptr->alloc = 0;
+  map_store(st_ptr, STORE_CHUNK_SAMPLES);
+  memcpy(st_ptr->map, SAMPLE_STORE_MAGIC, 8);
+  memset(st_ptr->map + 8, 0, 8);
+}
+
+void fini_sample_store(struct sample_store *st_ptr)
+{
+  if(!st_ptr->file_ptr){
+    return;
+  }
+  if(st_ptr->map){
+    uint64_t count = (uint64_t) st_ptr->count;
+    memcpy(st_ptr->map + 8, &count, sizeof(count));
+    if(munmap(st_ptr->map, st_ptr->map_size) == -1){
+      output(erro_lvl, "failure unmapping sample store file: %s", strerror(errno));
+    }
+    st_ptr->map = NULL;
+    /* drop the unused tail of the last chunk */
+    if(ftruncate(fileno(st_ptr->file_ptr),
+		 (off_t) (SAMPLE_STORE_HDR_SIZE + (size_t) st_ptr->count * sizeof(double))) == -1){
+      output(erro_lvl, "failure truncating sample store file: %s", strerror(errno));
+    }
+  }
+  fclose(st_ptr->file_ptr);
+  st_ptr->file_ptr = NULL;
+}
+
+void add_sample_store_sample(struct sample_store *st_ptr, double sample)
+{
+  if(st_ptr->count == st_ptr->alloc){
+    map_store(st_ptr, st_ptr->alloc + STORE_CHUNK_SAMPLES);
+  }
+  double *samples = (double *) (st_ptr->map + SAMPLE_STORE_HDR_SIZE);
+  samples[st_ptr->count++] = sample;
+}
+
+/* stats */
+long sample_store_count(const struct sample_store *st_ptr)
+{
+  return st_ptr->count;
+}
+
+void sample_store_percs(const struct sample_store *st_ptr, const double *percs,
+			double *values, int cnt)
+{
+  /* streaming radix selection over the order preserving integer keys of
+     the samples, the file is scanned once per digit and never reordered;
+     percentiles shall be given in ascending order */
+  const double *samples = (const double *) (st_ptr->map + SAMPLE_STORE_HDR_SIZE);
+  if(st_ptr->count == 0){
+    for(int i = 0; i < cnt; i++){
+      values[i] = NAN;
+    }
+    return;
+  }
+  uint64_t *prefixes = malloc((size_t) cnt * sizeof(uint64_t));
+  uint64_t *ranks = malloc((size_t) cnt * sizeof(uint64_t));
+  uint64_t *group_pfxs = malloc((size_t) cnt * sizeof(uint64_t));
+  int *groups = malloc((size_t) cnt * sizeof(int));
+  if(!prefixes || !ranks || !group_pfxs || !groups){
+    output(erro_lvl, "failure allocating memory for sample store selection");
+  }
+  for(int i = 0; i < cnt; i++){
+    prefixes[i] = 0;
+    ranks[i] = (uint64_t) (percs[i] * (double) (st_ptr->count - 1));
+  }
+  madvise(st_ptr->map, st_ptr->map_size, MADV_SEQUENTIAL);
+
+  for(int bits = 0; bits < 64; bits += SELECT_DIGIT_BITS){
+    int digit_bits = (64 - bits < SELECT_DIGIT_BITS) ? 64 - bits : SELECT_DIGIT_BITS;
+    int shift = 64 - bits - digit_bits;
+    uint64_t mask = (UINT64_C(1) << digit_bits) - 1;
+
+    /* percentiles sharing a prefix share a histogram, the prefixes are
+       sorted because the ranks are */
+    int group_cnt = 0;
+    for(int i = 0; i < cnt; i++){
+      if(group_cnt == 0 || group_pfxs[group_cnt - 1] != prefixes[i]){
+	group_pfxs[group_cnt++] = prefixes[i];
+      }
+      groups[i] = group_cnt - 1;
+    }
+    uint64_t *hist = calloc((size_t) group_cnt << digit_bits, sizeof(uint64_t));
+    if(!hist){
+      output(erro_lvl, "failure allocating memory for sample store selection");
+    }
+
+    for(long j = 0; j < st_ptr->count; j++){
+      uint64_t key = sample_key(samples[j]);
+      int g = find_group(group_pfxs, group_cnt, bits ? key >> (64 - bits) : 0);
+      if(g >= 0){
+	hist[((size_t) g << digit_bits) + ((key >> shift) & mask)]++;
+      }
+    }
+
+    for(int i = 0; i < cnt; i++){
+      const uint64_t *h = hist + ((size_t) groups[i] << digit_bits);
+      uint64_t digit = 0;
+      while(ranks[i] >= h[digit]){
+	ranks[i] -= h[digit];
+	digit++;
+      }
+      prefixes[i] = (prefixes[i] << digit_bits) | digit;
+    }
+    free(hist);
+  }
+
+  for(int i = 0; i < cnt; i++){
+    values[i] = key_sample(prefixes[i]);
+  }
+  free(prefixes);
+  free(ranks);
+  free(group_pfxs);
+  free(groups);
+}
+
+/* helper functions */
+static void map_store(struct sample_store *st_ptr, long alloc)
+{
+  size_t size = SAMPLE_STORE_HDR_SIZE + (size_t) alloc * sizeof(double);
+  if(ftruncate(fileno(st_ptr->file_ptr), (off_t) size) == -1){
+    output(erro_lvl, "failure growing sample store file: %s", strerror(errno));
+  }
+  void *map;
+  if(st_ptr->map){
+    map = mremap(st_ptr->map, st_ptr->map_size, size, MREMAP_MAYMOVE);
+  }else{
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(st_ptr->file_ptr), 0);
+  }
+  if(map == MAP_FAILED){
+    output(erro_lvl, "failure mapping sample store file: %s", strerror(errno));
+  }
+  /* the samples shall stay pageable even when memory is locked */
+  munlock(map, size);
+  st_ptr->map = map;
+  st_ptr->map_size = size;
+  st_ptr->alloc = alloc;
+}
+
+static uint64_t sample_key(double sample)
+{
+  /* flip the sign bit of positive samples and all bits of negative ones */
+  uint64_t bits;
+  memcpy(&bits, &sample, sizeof(bits));
+  return (bits >> 63) ? ~bits : bits | (UINT64_C(1) << 63);
+}
+
+static double key_sample(uint64_t key)
+{
+  uint64_t bits = (key >> 63) ? key & ~(UINT64_C(1) << 63) : ~key;
+  double sample;
+  memcpy(&sample, &bits, sizeof(sample));
+  return sample;
+}
+
+static int find_group(const uint64_t *group_pfxs, int group_cnt, uint64_t pfx)
+{
+  int low = 0;
+  int high = group_cnt - 1;
+  while(low <= high){
+    int mid = (low + high) / 2;
+    if(group_pfxs[mid] < pfx){
+      low = mid + 1;
+    }else if(group_pfxs[mid] > pfx){
+      high = mid - 1;
+    }else{
+      return mid;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,34 @@
+#ifndef PSPS_SAMPLE_STORE_H
+#define PSPS_SAMPLE_STORE_H
+
+/* C standard library headers */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* sample store file header, followed by the samples as doubles in host
+   byte order */
+#define SAMPLE_STORE_MAGIC "PSPSMPL1"
+#define SAMPLE_STORE_HDR_SIZE 16
+
+/* sample store data structure, samples are appended to a memory-mapped
+   file so that they are held in the page cache rather than in the heap */
+struct sample_store
+{
+  FILE *file_ptr;
+  uint8_t *map;
+  size_t map_size;
+  long count;
+  long alloc;
+};
+
+/* sample store management functions */
+void init_sample_store(struct sample_store *, FILE *);
+void fini_sample_store(struct sample_store *);
+void add_sample_store_sample(struct sample_store *, double);
+
+/* stats */
+long sample_store_count(const struct sample_store *);
+void sample_store_percs(const struct sample_store *, const double *, double *, int);
+
+#endif /* PSPS_SAMPLE_STORE_H */
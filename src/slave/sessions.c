@@ -0,0 +1,220 @@
+/* C standard library headers */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* POSIX library headers */
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+/* PSP Common headers */
+#include "../common/output.h"
+
+/* PSP Slave headers */
+#include "sessions.h"
+
+/* functions forward declarations */
+static void read_sessions_file(struct session_set *, const char *);
+static void split_cmd_line(struct session *);
+static void check_sessions(const struct session_set *);
+
+/* session set management functions */
+void init_sessions_from_file(struct session_set *set_ptr, const char *filename)
+{
+  struct epoll_event event;
+
+  set_ptr->count = 0;
+  set_ptr->active_count = 0;
+  set_ptr->sessions = NULL;
+  set_ptr->epoll_desc = -1;
+
+  read_sessions_file(set_ptr, filename);
+  for(long i = 0; i < set_ptr->count; i++){
+    struct session *sess_ptr = &set_ptr->sessions[i];
+    if(!parse_command_line(sess_ptr->argc, sess_ptr->argv, &sess_ptr->opts)){
+      output(erro_lvl, "invalid options for session %ld", sess_ptr->id);
+    }
+  }
+  check_sessions(set_ptr);
+
+  set_ptr->epoll_desc = epoll_create1(0);
+  if(set_ptr->epoll_desc == -1){
+    output(erro_lvl, "failure creating epoll instance: %s", strerror(errno));
+  }
+  for(long i = 0; i < set_ptr->count; i++){
+    struct session *sess_ptr = &set_ptr->sessions[i];
+    set_output_tag(sess_ptr->tag);
+    print_session_options(&sess_ptr->opts);
+    sess_ptr->active = 1;
+    set_ptr->active_count++;
+    init_state_from_options(&sess_ptr->state, &sess_ptr->opts);
+    set_output_tag(NULL);
+
+    int flags = fcntl(sess_ptr->state.socket_desc, F_GETFL);
+    event.events = EPOLLIN;
+    event.data.ptr = sess_ptr;
+    if((flags == -1) ||
+       (fcntl(sess_ptr->state.socket_desc, F_SETFL, flags | O_NONBLOCK) == -1)){
+      output(erro_lvl, "failure setting session %ld socket non-blocking", sess_ptr->id);
+    }else if(epoll_ctl(set_ptr->epoll_desc, EPOLL_CTL_ADD,
+		       sess_ptr->state.socket_desc, &event) == -1){
+      output(erro_lvl, "failure adding session %ld socket to epoll instance: %s",
+	     sess_ptr->id, strerror(errno));
+    }
+  }
+  output(info_lvl, "%ld sessions started", set_ptr->count);
+}
+
+void fini_sessions(struct session_set *set_ptr)
+{
+  for(long i = 0; i < set_ptr->count; i++){
+    struct session *sess_ptr = &set_ptr->sessions[i];
+    if(sess_ptr->active){
+      finish_session(set_ptr, sess_ptr);
+    }
+    free(sess_ptr->argv);
+    free(sess_ptr->cmd_line);
+  }
+  free(set_ptr->sessions);
+  set_ptr->sessions = NULL;
+  set_ptr->count = 0;
+  if((set_ptr->epoll_desc != -1) && (close(set_ptr->epoll_desc) == -1)){
+    output(erro_lvl, "failure closing epoll instance");
+  }
+  set_ptr->epoll_desc = -1;
+}
+
+void finish_session(struct session_set *set_ptr, struct session *sess_ptr)
+{
+  set_output_tag(sess_ptr->tag);
+  if((set_ptr->epoll_desc != -1) && (sess_ptr->state.socket_desc != -1)){
+    epoll_ctl(set_ptr->epoll_desc, EPOLL_CTL_DEL, sess_ptr->state.socket_desc, NULL);
+  }
+  sess_ptr->active = 0;
+  set_ptr->active_count--;
+  fini_state(&sess_ptr->state);
+  output(info_lvl, "finished");
+  set_output_tag(NULL);
+}
+
+/* helper functions */
+static void read_sessions_file(struct session_set *set_ptr, const char *filename)
+{
+  char *line = NULL;
+  size_t line_size = 0;
+  long line_num = 0;
+  struct session *sessions;
+
+  FILE *sess_file = fopen(filename, "r");
+  if(!sess_file){
+    output(erro_lvl, "cannot open sessions file '%s' for reading", filename);
+  }
+  while(getline(&line, &line_size, sess_file) != -1){
+    line_num++;
+    size_t skip = strspn(line, " \t\r\n");
+    if((line[skip] == '\0') || (line[skip] == '#')){
+      continue;
+    }
+    sessions = realloc(set_ptr->sessions, (size_t)(set_ptr->count + 1) * sizeof(struct session));
+    if(!sessions){
+      free(line);
+      fclose(sess_file);
+      output(erro_lvl, "failure allocating memory for sessions");
+    }
+    set_ptr->sessions = sessions;
+    struct session *sess_ptr = &set_ptr->sessions[set_ptr->count];
+    memset(sess_ptr, 0, sizeof(struct session));
+    set_ptr->count++;
+    sess_ptr->id = line_num;
+    snprintf(sess_ptr->tag, sizeof(sess_ptr->tag), "session %ld:", line_num);
+    sess_ptr->cmd_line = strdup(line);
+    if(!sess_ptr->cmd_line){
+      free(line);
+      fclose(sess_file);
+      output(erro_lvl, "failure allocating memory for sessions");
+    }
+    split_cmd_line(sess_ptr);
+  }
+  free(line);
+  fclose(sess_file);
+  if(set_ptr->count == 0){
+    output(erro_lvl, "no sessions found in sessions file '%s'", filename);
+  }
+}
+
+static void split_cmd_line(struct session *sess_ptr)
+{
+  char *token;
+  char **argv;
+  sess_ptr->argc = 1;
+  sess_ptr->argv = malloc(2 * sizeof(char *));
+  if(!sess_ptr->argv){
+    output(erro_lvl, "failure allocating memory for sessions");
+  }
+  sess_ptr->argv[0] = "psps";
+  token = strtok(sess_ptr->cmd_line, " \t\r\n");
+  while(token){
+    argv = realloc(sess_ptr->argv, (size_t)(sess_ptr->argc + 2) * sizeof(char *));
+    if(!argv){
+      output(erro_lvl, "failure allocating memory for sessions");
+    }
+    sess_ptr->argv = argv;
+    sess_ptr->argv[sess_ptr->argc++] = token;
+    token = strtok(NULL, " \t\r\n");
+  }
+  sess_ptr->argv[sess_ptr->argc] = NULL;
+}
+
+static void check_sessions(const struct session_set *set_ptr)
+{
+  long synch_cnt = 0;
+  for(long i = 0; i < set_ptr->count; i++){
+    const struct options *opts_ptr = &set_ptr->sessions[i].opts;
+    if(opts_ptr->sessions_filename){
+      output(erro_lvl, "sessions file cannot be specified in session %ld",
+	     set_ptr->sessions[i].id);
+    }
+    if(opts_ptr->busy_poll >= 0){
+      output(erro_lvl, "busy-poll reception cannot be enabled in session %ld",
+	     set_ptr->sessions[i].id);
+    }
+    if(opts_ptr->packet_ring){
+      output(erro_lvl, "packet ring reception cannot be enabled in session %ld",
+	     set_ptr->sessions[i].id);
+    }
+    if((opts_ptr->gen_opts.rt_prio > 0) || opts_ptr->gen_opts.cpu_list ||
+       opts_ptr->gen_opts.lock_mem){
+      output(erro_lvl, "real-time options cannot be set in session %ld, set them on the command line",
+	     set_ptr->sessions[i].id);
+    }
+    if((opts_ptr->gen_opts.verb_lvl != info_lvl) || opts_ptr->gen_opts.log_fname){
+      output(erro_lvl, "verbosity and log file cannot be set in session %ld, set them on the command line",
+	     set_ptr->sessions[i].id);
+    }
+    if(opts_ptr->rx_ring_size > 0){
+      output(erro_lvl, "reception thread cannot be enabled in session %ld",
+	     set_ptr->sessions[i].id);
+    }
+    if(opts_ptr->action == action_synch){
+      synch_cnt++;
+    }
+    for(long j = 0; j < i; j++){
+      const struct options *prev_opts_ptr = &set_ptr->sessions[j].opts;
+      if(prev_opts_ptr->slave_port == opts_ptr->slave_port){
+	output(erro_lvl, "sessions %ld and %ld use the same UDP port",
+	       set_ptr->sessions[j].id, set_ptr->sessions[i].id);
+      }
+      if((prev_opts_ptr->out_dir == opts_ptr->out_dir) ||
+	 (prev_opts_ptr->out_dir && opts_ptr->out_dir &&
+	  !strcmp(prev_opts_ptr->out_dir, opts_ptr->out_dir))){
+	output(erro_lvl, "sessions %ld and %ld use the same output directory",
+	       set_ptr->sessions[j].id, set_ptr->sessions[i].id);
+      }
+    }
+  }
+  if(synch_cnt > 1){
+    output(erro_lvl, "only one session can perform synchronization");
+  }
+}
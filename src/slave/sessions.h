@@ -0,0 +1,35 @@
+#ifndef PSPS_SESSIONS_H
+#define PSPS_SESSIONS_H
+
+/* PSP Slave headers */
+#include "options.h"
+#include "state.h"
+
+/* session data structure */
+struct session
+{
+  long id;
+  char tag[32];
+  char *cmd_line;
+  int argc;
+  char **argv;
+  struct options opts;
+  struct slave_state state;
+  int active;
+};
+
+/* session set data structure */
+struct session_set
+{
+  long count;
+  long active_count;
+  struct session *sessions;
+  int epoll_desc;
+};
+
+/* session set management functions */
+void init_sessions_from_file(struct session_set *, const char *);
+void fini_sessions(struct session_set *);
+void finish_session(struct session_set *, struct session *);
+
+#endif /* PSPS_SESSIONS_H */
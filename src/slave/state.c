@@ -1,10 +1,14 @@
 /* C standard library headers */
 #include <errno.h>
+#include <limits.h>
 #include <memory.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* POSIX library headers */
 #include <arpa/inet.h>
+#include <net/if.h>
 #include <netinet/in.h>
 #include <unistd.h>
 #include <sys/types.h>
@@ -12,6 +16,7 @@
 #include <time.h>
 
 /* PSP Common headers */
+#include "../common/net.h"
 #include "../common/output.h"
 
 /* PSP Slave headers */
@@ -20,29 +25,59 @@
 #include "state.h"
 #include "synch.h"
 
+/* functions forward declarations */
+static void join_group(const struct slave_state *, const struct options *);
+
 /* slave state management functions */
 void init_state_from_options(struct slave_state *state_ptr, const struct options *opt_ptr)
 {
   /* trivial state initializaton */
+  state_ptr->socket_desc = -1;
   state_ptr->pkt_cnt = opt_ptr->max_pkt_cnt;
   state_ptr->pkt_idx = 0;
-  state_ptr->pkt_buff = NULL;
+  state_ptr->pending = 0;
+  state_ptr->burst_pending = 0;
+  state_ptr->burst_cnt = 0;
+  state_ptr->burst_pkts = 0;
+  state_ptr->pkt_version = 0;
+  state_ptr->session_id = 0;
+  memset(&state_ptr->rx, 0, sizeof(state_ptr->rx));
+  /* fini_receiver may run before init_receiver when initialization fails */
+  state_ptr->rx.dma_lat_desc = -1;
+  memset(&state_ptr->ps, 0, sizeof(state_ptr->ps));
+  memset(&state_ptr->sketch, 0, sizeof(state_ptr->sketch));
+  state_ptr->sketching = (opt_ptr->action == action_calibr) &&
+    (opt_ptr->sketch_spec.type != sketch_exact);
+  state_ptr->sketch_merge_list = opt_ptr->sketch_merge_list;
+  memset(&state_ptr->store, 0, sizeof(state_ptr->store));
+  state_ptr->storing = (opt_ptr->action == action_calibr) && opt_ptr->sample_store;
+  state_ptr->calibr_cnt = 0;
+  memset(&state_ptr->ls, 0, sizeof(state_ptr->ls));
+  memset(&state_ptr->filter, 0, sizeof(state_ptr->filter));
+  state_ptr->rx_threaded = 0;
   state_ptr->clk_freq_ofs = 0.;
   state_ptr->action = opt_ptr->action;
   state_ptr->debug = opt_ptr->debug;
+  state_ptr->finished = 0;
   state_ptr->obs_win_start_time = -1.;
   state_ptr->first_clk_time = -1.;
   state_ptr->synch_method = opt_ptr->synch_method;
   state_ptr->freq_estim_slots = opt_ptr->freq_estim_slots;
+  state_ptr->slope_estim = opt_ptr->slope_estim;
   state_ptr->time_step_thr = (double)opt_ptr->time_step_thr / 1e6;
   state_ptr->time_corr_gain = 1. - (double)opt_ptr->time_corr_damp / 100.;
   state_ptr->freq_corr_gain = 1. - (double)opt_ptr->freq_corr_damp / 100.;
   state_ptr->time_corr_max = (double)opt_ptr->time_corr_clamp * 1e-9;
   state_ptr->freq_corr_max = (double)opt_ptr->freq_corr_clamp * 1e-9;
   state_ptr->qs_rounds = opt_ptr->qs_rounds;
+  state_ptr->corr_interval = opt_ptr->corr_interval;
+  state_ptr->corr_cnt = 0;
+  state_ptr->win_cnt = 0;
+  state_ptr->slide_corr = 0.;
   state_ptr->time_cumul_corr = 0.;
   state_ptr->freq_cumul_corr = 0.;
   state_ptr->obs_win = opt_ptr->obs_win;
+  state_ptr->out_dir = opt_ptr->out_dir;
   state_ptr->out_file = NULL;
   state_ptr->debug_timestamp_file = NULL;
   state_ptr->debug_corr_time_delta_file = NULL;
@@ -56,50 +91,86 @@ void init_state_from_options(struct slave_state *state_ptr, const struct options
   state_ptr->debug_freq_cumul_corr_file = NULL;
 
   /* socket initialization */
-  struct sockaddr_in host_addr;
-  host_addr.sin_family = AF_INET;
-  host_addr.sin_port = opt_ptr->slave_port;
-  host_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  struct sockaddr_storage host_addr;
+  int v6only = 0;
+  memset(&host_addr, 0, sizeof(host_addr));
+  if(opt_ptr->group.ss_family != AF_UNSPEC){
+    host_addr.ss_family = opt_ptr->group.ss_family;
+  }else{
+    host_addr.ss_family = opt_ptr->ipv6 ? AF_INET6 : AF_INET;
+  }
+  set_sockaddr_port(&host_addr, opt_ptr->slave_port);
 
-  state_ptr->socket_desc = socket(AF_INET, SOCK_DGRAM, 0);
+  state_ptr->socket_desc = socket(host_addr.ss_family, SOCK_DGRAM, 0);
   if(state_ptr->socket_desc == -1){
     output(erro_lvl, "failure creating UDP socket");
-  }else if(bind(state_ptr->socket_desc, (struct sockaddr *)&host_addr, sizeof(host_addr)) == -1){
+  }else if((host_addr.ss_family == AF_INET6) &&
+	   (setsockopt(state_ptr->socket_desc, IPPROTO_IPV6, IPV6_V6ONLY,
+		       &v6only, sizeof(v6only)) == -1)){
+    output(erro_lvl, "failure enabling IPv4 reception on IPv6 UDP socket");
+  }else if(bind(state_ptr->socket_desc, (struct sockaddr *)&host_addr,
+		sockaddr_len(&host_addr)) == -1){
     output(erro_lvl, "failure binding UDP socket");
   }
+  if(opt_ptr->group.ss_family != AF_UNSPEC){
+    join_group(state_ptr, opt_ptr);
+  }
 
   /* security functions initialization */
   if(opt_ptr->key_filename){
     state_ptr->secure = 1;
 
     /* secure key loading */
+    uint8_t key[32];
     FILE *key_file = fopen(opt_ptr->key_filename, "r");
     if(!key_file){
       output(erro_lvl, "cannot open key file '%s' for reading", opt_ptr->key_filename);
-    }else if(fread(&state_ptr->key, 32, 1, key_file) != 1){
+    }else if(fread(key, 32, 1, key_file) != 1){
 	output(erro_lvl, "failure reading key from key file '%s'", opt_ptr->key_filename);
     }else if(fclose(key_file) == EOF){
       output(erro_lvl, "failure closing key file '%s'", opt_ptr->key_filename);
     }
+    init_mac_context(&state_ptr->mac_ctx, &opt_ptr->mac_spec, key);
+    state_ptr->mac_ptr = &state_ptr->mac_ctx;
+    memset(key, 0, sizeof(key));
   }else{
     state_ptr->secure = 0;
+    state_ptr->mac_ptr = NULL;
   }
 
   /* statistics initialization */
-  long max_obs_win = state_ptr->obs_win;
+  state_ptr->max_obs_win = state_ptr->obs_win;
   for(long i = 0; i < state_ptr->qs_rounds; i++){
-    max_obs_win *= 2;
+    state_ptr->max_obs_win *= 2;
   }
   reset_basic_stats(&state_ptr->bs);
-  init_perc_stats(&state_ptr->ps, max_obs_win);
+  reset_basic_stats(&state_ptr->rx_lat_bs);
+  if(state_ptr->sketching){
+    /* the sketch memory does not depend on the window size */
+    init_quant_sketch(&state_ptr->sketch, &opt_ptr->sketch_spec);
+  }else if(!state_ptr->storing){
+    init_perc_stats(&state_ptr->ps, state_ptr->max_obs_win);
+  }
   init_least_squares(&state_ptr->ls, 1000);
+  if(opt_ptr->gen_opts.lock_mem && !state_ptr->sketching && !state_ptr->storing){
+    prefault_perc_stats(&state_ptr->ps);
+  }
+  if(opt_ptr->gen_opts.lock_mem){
+    prefault_least_squares(&state_ptr->ls);
+  }
+
+  /* receiver initialization, both packet format versions are accepted */
+  size_t pkt_sizes[] = {ts_pkt_size(state_ptr->mac_ptr, ts_pkt_v1, ts_pkt_sync),
+			ts_pkt_size(state_ptr->mac_ptr, ts_pkt_v1, ts_pkt_follow_up),
+			ts_pkt_size(state_ptr->mac_ptr, ts_pkt_v2, ts_pkt_follow_up)};
+  state_ptr->pkt_size = pkt_sizes[2];
+  init_receiver(&state_ptr->rx, state_ptr->socket_desc, state_ptr->pkt_size, opt_ptr);
 
-  /* packet buffer initialization */
-  state_ptr->pkt_size = ts_pkt_size(state_ptr->secure);
-  state_ptr->pkt_buff = malloc(state_ptr->pkt_size + 1); /* +1 is needed to detect packets 
-                                                            longer than valid ones */
-  if(!state_ptr->pkt_buff){
-    output(erro_lvl, "cannot allocate buffer for timestamp packets transmission");
+  /* reception filter initialization, the packet ring socket has its own filter */
+  init_rx_filter(&state_ptr->filter, opt_ptr);
+  if(!opt_ptr->packet_ring){
+    attach_rx_filter(&state_ptr->filter, state_ptr->socket_desc, pkt_sizes,
+		     sizeof(pkt_sizes) / sizeof(pkt_sizes[0]));
   }
 
   /* file initialization */
@@ -115,14 +186,22 @@ void init_state_from_options(struct slave_state *state_ptr, const struct options
     break;
   }
 
+  /* reception thread initialization */
+  if(opt_ptr->rx_ring_size > 0){
+    state_ptr->rx_threaded = 1;
+    init_rx_thread(&state_ptr->rxt, &state_ptr->rx, state_ptr->mac_ptr,
+		   &state_ptr->filter, opt_ptr->rx_ring_size);
+  }
+
   // initialization finished
   output(debg_lvl, "Slave state created");
 }
 
-void fini_state(void *ptr)
+void fini_state(struct slave_state *state_ptr)
 {
-  struct slave_data *data_ptr = (struct slave_data *) ptr;
-  struct slave_state *state_ptr = (struct slave_state *) &data_ptr->state;
+  if(state_ptr->rx_threaded){
+    fini_rx_thread(&state_ptr->rxt);
+  }
 
   switch(state_ptr->action){
     case action_precalibr:
@@ -136,7 +215,17 @@ void fini_state(void *ptr)
       break;
   }
 
-  free(state_ptr->pkt_buff);
+  if(state_ptr->rx.kernel_ts && basic_stats_count(&state_ptr->rx_lat_bs)){
+    output(info_lvl, "kernel to user space reception latency:");
+    print_basic_stats(&state_ptr->rx_lat_bs, info_lvl);
+  }
+
+  if(state_ptr->burst_cnt){
+    output(info_lvl, "received %lu bursts, %.2f packets per burst", state_ptr->burst_cnt,
+	   (double) state_ptr->burst_pkts / (double) state_ptr->burst_cnt);
+  }
+  fini_rx_filter(&state_ptr->filter);
+  fini_receiver(&state_ptr->rx);
   if(state_ptr->out_file){
     fclose(state_ptr->out_file);
   }
@@ -172,5 +261,65 @@ void fini_state(void *ptr)
   }
 
   fini_perc_stats(&state_ptr->ps);
+  fini_quant_sketch(&state_ptr->sketch);
+  fini_sample_store(&state_ptr->store);
   fini_least_squares(&state_ptr->ls);
+  if((state_ptr->socket_desc != -1) && (close(state_ptr->socket_desc) == -1)){
+    output(erro_lvl, "failure closing UDP socket");
+  }
+}
+
+/* slave files management functions */
+FILE *open_output_file(const struct slave_state *state_ptr, const char *filename,
+		       const char *mode)
+{
+  char path[PATH_MAX];
+  if(!state_ptr->out_dir){
+    return fopen(filename, mode);
+  }else if(snprintf(path, sizeof(path), "%s/%s", state_ptr->out_dir,
+		    filename) >= (int) sizeof(path)){
+    output(erro_lvl, "path of file '%s' is too long", filename);
+    return NULL;
+  }else{
+    return fopen(path, mode);
+  }
+}
+
+/* helper functions */
+static void join_group(const struct slave_state *state_ptr, const struct options *opt_ptr)
+{
+  int level = (opt_ptr->group.ss_family == AF_INET6) ? IPPROTO_IPV6 : IPPROTO_IP;
+  unsigned int ifindex = 0;
+  char addr_str[SOCKADDR_STR_LEN];
+
+  if(opt_ptr->ifname){
+    ifindex = if_nametoindex(opt_ptr->ifname);
+    if(!ifindex){
+      output(erro_lvl, "unknown interface '%s'", opt_ptr->ifname);
+    }
+  }
+  if(opt_ptr->source.ss_family != AF_UNSPEC){
+    struct group_source_req gsr;
+    memset(&gsr, 0, sizeof(gsr));
+    gsr.gsr_interface = ifindex;
+    memcpy(&gsr.gsr_group, &opt_ptr->group, sizeof(gsr.gsr_group));
+    memcpy(&gsr.gsr_source, &opt_ptr->source, sizeof(gsr.gsr_source));
+    if(setsockopt(state_ptr->socket_desc, level, MCAST_JOIN_SOURCE_GROUP,
+		  &gsr, sizeof(gsr)) == -1){
+      output(erro_lvl, "failure joining multicast group %s: %s",
+	     sockaddr_to_str(&opt_ptr->group, addr_str, sizeof(addr_str)), strerror(errno));
+    }
+  }else{
+    struct group_req gr;
+    memset(&gr, 0, sizeof(gr));
+    gr.gr_interface = ifindex;
+    memcpy(&gr.gr_group, &opt_ptr->group, sizeof(gr.gr_group));
+    if(setsockopt(state_ptr->socket_desc, level, MCAST_JOIN_GROUP,
+		  &gr, sizeof(gr)) == -1){
+      output(erro_lvl, "failure joining multicast group %s: %s",
+	     sockaddr_to_str(&opt_ptr->group, addr_str, sizeof(addr_str)), strerror(errno));
+    }
+  }
+  output(debg_lvl, "joined multicast group %s",
+	 sockaddr_to_str(&opt_ptr->group, addr_str, sizeof(addr_str)));
 }
@@ -7,13 +7,18 @@
 #include <time.h>
 
 /* PSP Common headers */
+#include "../common/basic_stats.h"
 #include "../common/timestamp.h"
 
 /* PSP Slave headers */
-#include "basic_stats.h"
 #include "least_squares.h"
 #include "options.h"
 #include "perc_stats.h"
+#include "quant_sketch.h"
+#include "sample_store.h"
+#include "receiver.h"
+#include "rx_filter.h"
+#include "rx_thread.h"
 
 /* slave state structure */
 struct slave_state
@@ -24,22 +29,55 @@ struct slave_state
 
   /* secure protocol data */
   int secure;
-  uint8_t key[32];
+  struct mac_context mac_ctx;
+  const struct mac_context *mac_ptr;
+
+  /* flood and replay filtering */
+  struct rx_filter filter;
 
   /* timestamp reception data */
   long pkt_cnt;
   ts_pkt_idx_t pkt_idx;
   size_t pkt_size;
-  uint8_t *pkt_buff;
+  int pkt_version;
+  uint32_t session_id;
+  struct receiver rx;
+  int rx_threaded;
+  struct rx_thread rxt;
   double clk_freq_ofs;
 
+  /* two-step reception data */
+  int pending;
+  struct ts_pkt pending_pkt;
+  struct timespec pending_rx_ts;
+  struct timespec pending_user_ts;
+
+  /* burst reception data, the least delayed packet is kept */
+  int burst_pending;
+  ts_pkt_idx_t burst_idx;
+  struct ts_pkt burst_pkt;
+  struct timespec burst_rx_ts;
+  struct timespec burst_user_ts;
+  double burst_delta;
+  unsigned long burst_cnt;
+  unsigned long burst_pkts;
+
   /* action */
   int action;
   int debug;
+  int finished;
   
   /* statistics */
   struct basic_stats bs;
+  struct basic_stats rx_lat_bs;
   struct perc_stats ps;
+  int sketching;
+  struct quant_sketch sketch;
+  const char *sketch_merge_list;
+  int storing;
+  struct sample_store store;
+  long max_obs_win;
+  long calibr_cnt;
   struct least_squares ls;
   double median_time_off;
 
@@ -49,17 +87,23 @@ struct slave_state
   double first_delta;
   int synch_method;
   long freq_estim_slots;
+  int slope_estim;
   double time_step_thr;
   double time_corr_gain;
   double freq_corr_gain;
   double time_corr_max;
   double freq_corr_max;
   long qs_rounds;
+  long corr_interval;
+  long corr_cnt;
+  long win_cnt;
+  double slide_corr;
   double time_cumul_corr;
   double freq_cumul_corr;
   long obs_win;
 
   /* files */
+  const char *out_dir;
   FILE *out_file;
   FILE *debug_timestamp_file;
   FILE *debug_corr_time_delta_file;
@@ -74,14 +118,19 @@ struct slave_state
 };
 
 /* slave data structure */
+struct session_set;
 struct slave_data
 {
   struct options opts;
   struct slave_state state;
+  struct session_set *sessions;
 };
 
 /* slave state management functions */
 void init_state_from_options(struct slave_state *, const struct options *);
-void fini_state(void *);
+void fini_state(struct slave_state *);
+
+/* slave files management functions */
+FILE *open_output_file(const struct slave_state *, const char *, const char *);
 
 #endif /* PSPS_STATE_H */
@@ -28,6 +28,7 @@ struct corrections
 };
 
 /* functions forward declarations */
+static double apply_corrections(struct slave_state *, double, double);
 static double clamp(double, double);
 static void perform_sudden_time_correction(double);
 static struct corrections perform_synch_step(struct slave_state *, double, double);
@@ -37,7 +38,7 @@ static struct corrections perform_synch_freq(struct slave_state *, double, doubl
 /* sychronization initialization */
 void init_synch(struct slave_state *state_ptr)
 {
-  FILE *in_file = fopen("calibr_results.txt", "r");
+  FILE *in_file = open_output_file(state_ptr, "calibr_results.txt", "r");
   if(!in_file){
       output(erro_lvl, "cannot open calibration output file.");
   }else{
@@ -49,35 +50,35 @@ void init_synch(struct slave_state *state_ptr)
   }
 
   if(state_ptr->debug){
-    state_ptr->debug_timestamp_file = fopen("synch_timestamp.txt", "w");
+    state_ptr->debug_timestamp_file = open_output_file(state_ptr, "synch_timestamp.txt", "w");
     if(!state_ptr->debug_timestamp_file){
       output(erro_lvl, "cannot open synchronization timestamp file");
     }
-    state_ptr->debug_corr_time_delta_file = fopen("synch_corr_time_delta.txt", "w");
+    state_ptr->debug_corr_time_delta_file = open_output_file(state_ptr, "synch_corr_time_delta.txt", "w");
     if(!state_ptr->debug_corr_time_delta_file){
       output(erro_lvl, "cannot open synchronization corrected time delta file");
     }
-    state_ptr->debug_time_error_file = fopen("synch_time_error.txt", "w");
+    state_ptr->debug_time_error_file = open_output_file(state_ptr, "synch_time_error.txt", "w");
     if(!state_ptr->debug_time_error_file){
       output(erro_lvl, "cannot open synchronization time error file");
     }
-    state_ptr->debug_time_corr_file = fopen("synch_time_correction.txt", "w");
+    state_ptr->debug_time_corr_file = open_output_file(state_ptr, "synch_time_correction.txt", "w");
     if(!state_ptr->debug_time_corr_file){
       output(erro_lvl, "cannot open synchronization time correction file");
     }
-    state_ptr->debug_time_cumul_corr_file = fopen("synch_time_cumul_correction.txt", "w");
+    state_ptr->debug_time_cumul_corr_file = open_output_file(state_ptr, "synch_time_cumul_correction.txt", "w");
     if(!state_ptr->debug_time_cumul_corr_file){
       output(erro_lvl, "cannot open synchronization time cumulative correction file");
     }
-    state_ptr->debug_freq_error_file = fopen("synch_freq_error.txt", "w");
+    state_ptr->debug_freq_error_file = open_output_file(state_ptr, "synch_freq_error.txt", "w");
     if(!state_ptr->debug_freq_error_file){
       output(erro_lvl, "cannot open synchronization frequency error file");
     }
-    state_ptr->debug_freq_corr_file = fopen("synch_freq_correction.txt", "w");
+    state_ptr->debug_freq_corr_file = open_output_file(state_ptr, "synch_freq_correction.txt", "w");
     if(!state_ptr->debug_freq_corr_file){
       output(erro_lvl, "cannot open synchronization frequency correction file");
     }
-    state_ptr->debug_freq_cumul_corr_file = fopen("synch_freq_cumul_correction.txt", "w");
+    state_ptr->debug_freq_cumul_corr_file = open_output_file(state_ptr, "synch_freq_cumul_correction.txt", "w");
     if(!state_ptr->debug_freq_cumul_corr_file){
       output(erro_lvl, "cannot open synchronization frequency cumulative correction file");
     }
@@ -95,6 +96,9 @@ void init_synch(struct slave_state *state_ptr)
   }
 
   output(info_lvl, "setting observation window to %ld samples", state_ptr->obs_win);
+  if(state_ptr->corr_interval){
+    output(info_lvl, "sliding observation window, correcting every %ld samples", state_ptr->corr_interval);
+  }
 }
 
 void fini_synch(struct slave_state *state_ptr)
@@ -140,88 +144,128 @@ void synch_handle_ts(struct slave_state *state_ptr, double clk_time, double time
     }
   }
 
-  add_perc_stats_sample(&state_ptr->ps, corrected_delta);
-  if(perc_stats_count(&state_ptr->ps) == state_ptr->obs_win){
-    double median_delta = perc_stats_perc(&state_ptr->ps, 0.5) - uncorr_delta;
-    double time_error = median_delta - state_ptr->median_time_off;
+  double median_delta;
+  int win_end;
+  if(state_ptr->corr_interval){
+    /* sliding window, samples are stored net of the time corrections applied
+       so far so that they stay comparable after each correction */
+    slide_perc_stats_sample(&state_ptr->ps, corrected_delta - state_ptr->slide_corr,
+                            state_ptr->obs_win);
+    win_end = (++state_ptr->win_cnt == state_ptr->obs_win);
+    if(perc_stats_count(&state_ptr->ps) < state_ptr->obs_win ||
+       (++state_ptr->corr_cnt < state_ptr->corr_interval && !win_end)){
+      return;
+    }
+    state_ptr->corr_cnt = 0;
+    median_delta = perc_stats_perc(&state_ptr->ps, 0.5) + state_ptr->slide_corr - uncorr_delta;
+  }else{
+    add_perc_stats_sample(&state_ptr->ps, corrected_delta);
+    win_end = (perc_stats_count(&state_ptr->ps) == state_ptr->obs_win);
+    if(!win_end){
+      return;
+    }
+    median_delta = perc_stats_perc(&state_ptr->ps, 0.5) - uncorr_delta;
+  }
 
-    double freq_error = 0.;
-    if(state_ptr->synch_method == synch_freq){
-      double avg_x = state_ptr->obs_win_start_time +
-        (clk_time - state_ptr->obs_win_start_time) / 2.;
-      double median_y = median_delta - state_ptr->time_cumul_corr;
-      least_squares_add_xy(&state_ptr->ls, avg_x, median_y);
-      if(least_squares_count(&state_ptr->ls) == state_ptr->freq_estim_slots) {
-        freq_error = least_squares_dy(&state_ptr->ls);
-        reset_least_squares(&state_ptr->ls);
+  double time_error = median_delta - state_ptr->median_time_off;
+
+  /* frequency is estimated over disjoint observation windows only */
+  double freq_error = 0.;
+  if(win_end && state_ptr->synch_method == synch_freq){
+    double avg_x = state_ptr->obs_win_start_time +
+      (clk_time - state_ptr->obs_win_start_time) / 2.;
+    double median_y = median_delta - state_ptr->time_cumul_corr;
+    least_squares_add_xy(&state_ptr->ls, avg_x, median_y);
+    if(least_squares_count(&state_ptr->ls) == state_ptr->freq_estim_slots) {
+      freq_error = least_squares_slope(&state_ptr->ls, state_ptr->slope_estim);
+      if(state_ptr->slope_estim == slope_least_squares && least_squares_count(&state_ptr->ls) > 2){
+        output(info_lvl, "frequency error standard error: %.9f", least_squares_dy_stderr(&state_ptr->ls));
       }
+      reset_least_squares(&state_ptr->ls);
     }
+  }
 
-    output(info_lvl, "time error: %.9f", time_error);
-    if(fabs(freq_error) > 0.){
-      output(info_lvl, "frequency error: %.9f", freq_error);
+  double time_corr = apply_corrections(state_ptr, time_error, freq_error);
+  if(state_ptr->corr_interval){
+    /* a new adjustment replaces the one still pending, which is never applied */
+    state_ptr->slide_corr += time_corr;
+    if(state_ptr->synch_method != synch_step && fabs(time_error) < state_ptr->time_step_thr){
+      state_ptr->slide_corr -= uncorr_delta;
     }
+  }
 
-    struct corrections corrs;
-    switch(state_ptr->synch_method)
-    {
-      case synch_step:
-        corrs = perform_synch_step(state_ptr, time_error, freq_error);
-        break;
-      case synch_smooth:
-        corrs = perform_synch_smooth(state_ptr, time_error, freq_error);
-        break;
-      case synch_freq:
-        corrs = perform_synch_freq(state_ptr, time_error, freq_error);
+  if(win_end){
+    if(state_ptr->qs_rounds){
+      state_ptr->qs_rounds--;
+      state_ptr->obs_win *= 2;
+      output(info_lvl, "setting observation window to %ld samples", state_ptr->obs_win);
     }
+    state_ptr->obs_win_start_time = -1.;
+    state_ptr->win_cnt = 0;
+    if(!state_ptr->corr_interval){
+      reset_perc_stats(&state_ptr->ps);
+    }
+  }
+}
+
+/* helper functions */
+static double apply_corrections(struct slave_state *state_ptr, double time_error, double freq_error)
+{
+  output(info_lvl, "time error: %.9f", time_error);
+  if(fabs(freq_error) > 0.){
+    output(info_lvl, "frequency error: %.9f", freq_error);
+  }
 
-    double time_corr = corrs.time_corr;
-    double freq_corr = corrs.freq_corr;
+  struct corrections corrs;
+  switch(state_ptr->synch_method)
+  {
+    case synch_step:
+      corrs = perform_synch_step(state_ptr, time_error, freq_error);
+      break;
+    case synch_smooth:
+      corrs = perform_synch_smooth(state_ptr, time_error, freq_error);
+      break;
+    case synch_freq:
+      corrs = perform_synch_freq(state_ptr, time_error, freq_error);
+  }
 
-    state_ptr->time_cumul_corr += time_corr;
-    state_ptr->freq_cumul_corr += freq_corr;
+  double time_corr = corrs.time_corr;
+  double freq_corr = corrs.freq_corr;
 
-    if(state_ptr->debug){
-      if(fprintf(state_ptr->debug_time_error_file, "%lu %.9f\n",
-                 basic_stats_count(&state_ptr->bs) - 1, time_error) < 0){
-        output(erro_lvl, "cannot write time error to file");
-      }
-      if(fprintf(state_ptr->debug_time_corr_file, "%lu %.9f\n",
-                 basic_stats_count(&state_ptr->bs) - 1, time_corr) < 0){
-        output(erro_lvl, "cannot write time correction to file");
+  state_ptr->time_cumul_corr += time_corr;
+  state_ptr->freq_cumul_corr += freq_corr;
+
+  if(state_ptr->debug){
+    if(fprintf(state_ptr->debug_time_error_file, "%lu %.9f\n",
+               basic_stats_count(&state_ptr->bs) - 1, time_error) < 0){
+      output(erro_lvl, "cannot write time error to file");
+    }
+    if(fprintf(state_ptr->debug_time_corr_file, "%lu %.9f\n",
+               basic_stats_count(&state_ptr->bs) - 1, time_corr) < 0){
+      output(erro_lvl, "cannot write time correction to file");
+    }
+    if(fprintf(state_ptr->debug_time_cumul_corr_file, "%lu %.9f\n",
+               basic_stats_count(&state_ptr->bs) - 1, state_ptr->time_cumul_corr) < 0){
+      output(erro_lvl, "cannot write cumulative time correction to file");
+    }
+    if(fabs(freq_corr) > 0.){
+      if(fprintf(state_ptr->debug_freq_error_file, "%lu %.9f\n",
+                 basic_stats_count(&state_ptr->bs) - 1, freq_error) < 0){
+        output(erro_lvl, "cannot write frequency error to file");
       }
-      if(fprintf(state_ptr->debug_time_cumul_corr_file, "%lu %.9f\n",
-                 basic_stats_count(&state_ptr->bs) - 1, state_ptr->time_cumul_corr) < 0){
-        output(erro_lvl, "cannot write cumulative time correction to file");
+      if(fprintf(state_ptr->debug_freq_corr_file, "%lu %.9f\n",
+                 basic_stats_count(&state_ptr->bs) - 1, freq_corr) < 0){
+        output(erro_lvl, "cannot write frequency correction to file");
       }
-      if(fabs(freq_corr) > 0.){
-        if(fprintf(state_ptr->debug_freq_error_file, "%lu %.9f\n",
-                   basic_stats_count(&state_ptr->bs) - 1, freq_error) < 0){
-          output(erro_lvl, "cannot write frequency error to file");
-        }
-        if(fprintf(state_ptr->debug_freq_corr_file, "%lu %.9f\n",
-                   basic_stats_count(&state_ptr->bs) - 1, freq_corr) < 0){
-          output(erro_lvl, "cannot write frequency correction to file");
-        }
-        if(fprintf(state_ptr->debug_freq_cumul_corr_file, "%lu %.9f\n",
-                   basic_stats_count(&state_ptr->bs) - 1, state_ptr->freq_cumul_corr) < 0){
-          output(erro_lvl, "cannot write cumulative frequency correction to file");
-        }
+      if(fprintf(state_ptr->debug_freq_cumul_corr_file, "%lu %.9f\n",
+                 basic_stats_count(&state_ptr->bs) - 1, state_ptr->freq_cumul_corr) < 0){
+        output(erro_lvl, "cannot write cumulative frequency correction to file");
       }
     }
-
-    if(state_ptr->qs_rounds){
-      state_ptr->qs_rounds--;
-      state_ptr->obs_win *= 2;
-      output(info_lvl, "setting observation window to %ld samples", state_ptr->obs_win);
-    }
-
-  state_ptr->obs_win_start_time = -1.;
-   reset_perc_stats(&state_ptr->ps);
   }
+  return time_corr;
 }
 
-/* helper functions */
 double clamp(double val, double max_val)
 {
   if(val > 0){